@@ -1,13 +1,19 @@
 #include "backend.h"
 #include "core.h"
 #include "lexer.h"
+#include "parallel.h"
 #include "thir.h"
 #include "type.h"
+#include <llvm-c/BitReader.h>
+#include <llvm-c/BitWriter.h>
 #include <llvm-c/Core.h>
 #include <llvm-c/Error.h>
+#include <llvm-c/LLJIT.h>
+#include <llvm-c/Linker.h>
 #include <llvm-c/TargetMachine.h>
 #include <llvm-c/Transforms/PassBuilder.h>
 #include <llvm-c/Types.h>
+#include <time.h>
 
 static void print_type(LLVMTypeRef type) {
   char *llvm_type_str = LLVMPrintTypeToString(type);
@@ -21,66 +27,38 @@ static void print_value(LLVMValueRef value) {
   LLVMDisposeMessage(value_str);
 }
 
-static inline char *unescape_string_lit(const char *s) {
-  size_t len = strlen(s);
-  char *res = (char *)malloc(len + 1);
-  char *dst = res;
-  const char *src = s;
-  while (*src) {
-    if (*src == '\\') {
-      src++;
-      switch (*src) {
-        case 'e':
-          *dst++ = '\x1B';
-          break;
-        case 'n':
-          *dst++ = '\n';
-          break;
-        case 't':
-          *dst++ = '\t';
-          break;
-        case 'r':
-          *dst++ = '\r';
-          break;
-        case 'f':
-          *dst++ = '\f';
-          break;
-        case 'v':
-          *dst++ = '\v';
-          break;
-        case 'a':
-          *dst++ = '\a';
-          break;
-        case 'b':
-          *dst++ = '\b';
-          break;
-        case '\\':
-          *dst++ = '\\';
-          break;
-        case '\'':
-          *dst++ = '\'';
-          break;
-        case '\"':
-          *dst++ = '\"';
-          break;
-        case '\?':
-          *dst++ = '\?';
-          break;
-        case '0':
-          *dst++ = '\0';
-          break;
-        default:
-          *dst++ = '\\';
-          *dst++ = *src;
-          break;
-      }
-    } else {
-      *dst++ = *src;
+static u64 emitted_value_hash(THIR *node) {
+  return hash_bytes(&node, sizeof(node));
+}
+
+static LLVMValueRef find_emitted_value(LLVM_Emit_Context *ctx, THIR *node) {
+  size_t cursor = 0, index;
+  u64 hash = emitted_value_hash(node);
+  while ((index = hash_index_next(&ctx->values_index, hash, &cursor)) != HASH_INDEX_END) {
+    Emitted_Value *emitted = V_PTR_AT(Emitted_Value, ctx->values, index);
+    if (emitted->node == node) {
+      return emitted->value;
     }
-    src++;
   }
-  *dst = '\0';
-  return res;
+  return nullptr;
+}
+
+static void insert_emitted_value(LLVM_Emit_Context *ctx, THIR *node, LLVMValueRef value) {
+  hash_index_insert(&ctx->values_index, emitted_value_hash(node), ctx->values.length);
+  vector_push(&ctx->values, &(Emitted_Value){.node = node, .value = value});
+}
+
+// allocas outside the entry block get a new slot every time they're reached, and mem2reg & sroa only promote the
+// ones in it, so every local is allocated up front regardless of where it's declared.
+static LLVMValueRef emit_entry_alloca(LLVM_Emit_Context *ctx, LLVMTypeRef type, const char *name) {
+  LLVMBasicBlockRef entry = LLVMGetEntryBasicBlock(ctx->function);
+  LLVMValueRef first = LLVMGetFirstInstruction(entry);
+  if (first) {
+    LLVMPositionBuilderBefore(ctx->alloca_builder, first);
+  } else {
+    LLVMPositionBuilderAtEnd(ctx->alloca_builder, entry);
+  }
+  return LLVMBuildAlloca(ctx->alloca_builder, type, name);
 }
 
 #define DONT_LOAD(old_state, ctx, block) \
@@ -89,119 +67,497 @@ static inline char *unescape_string_lit(const char *s) {
   block ctx->dont_load = old_state;
 
 LLVMTypeRef to_llvm_type(LLVM_Emit_Context *ctx, Type *type) {
-  if (type->llvm_type) return type->llvm_type;
+  if (ctx->types[type->id]) return ctx->types[type->id];
+  LLVMTypeRef result;
   switch (type->kind) {
-    case VOID: {
-      static LLVMTypeRef type;
-      if (!type) type = LLVMVoidType();
-      return type;
-    }
-    case STRING: {
-      static LLVMTypeRef type;
-      if (!type) type = LLVMPointerType(LLVMInt8Type(), 0);
-      return type;
-    }
-    case I32: {
-      static LLVMTypeRef type;
-      if (!type) type = LLVMInt32Type();
-      return type;
-    }
+    case VOID:
+      result = LLVMVoidTypeInContext(ctx->context);
+      break;
+    case STRING:
+      result = LLVMPointerType(LLVMInt8TypeInContext(ctx->context), 0);
+      break;
+    case I8:
+    case I16:
+    case I32:
+    case I64:
+    case U8:
+    case U16:
+    case U32:
+    case U64:
+      result = LLVMIntTypeInContext(ctx->context, type_integer_bits(type->id));
+      break;
+    case F32:
+      result = LLVMFloatTypeInContext(ctx->context);
+      break;
     case STRUCT: {
-      type->llvm_type = LLVMStructCreateNamed(ctx->context, type->name.data);
+      // cached before the members, so a member can refer back to the struct.
+      result = ctx->types[type->id] = LLVMStructCreateNamed(ctx->context, type->name.data);
       LLVMTypeRef elements[type->$struct.members.length];
       ForEach(Type_Member, member, type->$struct.members,
-              { elements[i] = to_llvm_type(ctx, V_PTR_AT(Type, type_table, member.type)); });
-      LLVMStructSetBody(type->llvm_type, elements, type->$struct.members.length, false);
-      return type->llvm_type;
+              { elements[i] = to_llvm_type(ctx, get_type(member.type)); });
+      LLVMStructSetBody(result, elements, type->$struct.members.length, false);
+      break;
     }
     case FUNCTION: {
       LLVMTypeRef return_type = to_llvm_type(ctx, get_type(type->$function.$return));
       size_t params_size = type->$function.parameters.length;
 
-      if (type->$function.is_varargs) {
-        params_size--;
-      }
-
-      LLVMTypeRef param_types[params_size];
-      for (int i = 0; i < type->$function.parameters.length; ++i) {
+      // the vararg parameter isn't one of the type's parameters, it only makes the type variadic.
+      LLVMTypeRef param_types[params_size + 1];
+      for (size_t i = 0; i < params_size; ++i) {
         param_types[i] = to_llvm_type(ctx, get_type(V_AT(size_t, type->$function.parameters, i)));
       }
 
-      type->llvm_type = LLVMFunctionType(return_type, param_types, type->$function.parameters.length, false);
-      return type->llvm_type;
+      result = LLVMFunctionType(return_type, param_types, params_size, type->$function.is_varargs);
+      break;
     }
-    case F32:
-      return LLVMFloatType();
   }
+  ctx->types[type->id] = result;
+  return result;
 }
 
 LLVMValueRef emit_thir_node(LLVM_Emit_Context *ctx, THIR *node);
 
-LLVMValueRef emit_thir_program(LLVM_Emit_Context *ctx, THIR *program) {
-  ctx->context = LLVMContextCreate();
-  ctx->builder = LLVMCreateBuilderInContext(ctx->context);
-  ctx->module = LLVMModuleCreateWithNameInContext("program", ctx->context);
+// what a function is called in the module. nested functions can share a name, so anything the outside world
+// doesn't refer to by name gets its function id appended, which partitions declare each other's functions by too.
+static const char *function_symbol(THIR *function, char *buffer, size_t size) {
+  if (function->function.is_entry || function->function.is_export || function->function.is_extern) {
+    return function->function.name.data;
+  }
+  snprintf(buffer, size, "%.*s.%u", (int)function->function.name.length, function->function.name.data,
+           function->function.id);
+  return buffer;
+}
+
+static void exit_on_llvm_error(LLVMErrorRef error, const char *doing) {
+  if (error) {
+    char *message = LLVMGetErrorMessage(error);
+    fprintf(stderr, "Error %s :: %s\n", doing, message);
+    LLVMDisposeErrorMessage(message);
+    exit(1);
+  }
+}
 
-  LLVMInitializeNativeTarget();
+static const char *opt_level_name() {
+  static const char *names[] = {"O0", "O1", "O2", "O3", "Os", "Oz"};
+  return names[OPT_LEVEL];
+}
+
+static LLVMCodeGenOptLevel codegen_opt_level() {
+  switch (OPT_LEVEL) {
+    case OPT_O0:
+      return LLVMCodeGenLevelNone;
+    case OPT_O1:
+      return LLVMCodeGenLevelLess;
+    case OPT_O3:
+      return LLVMCodeGenLevelAggressive;
+    default:
+      return LLVMCodeGenLevelDefault;
+  }
+}
+
+static void run_passes(LLVM_Emit_Context *ctx, const char *passes) {
+  LLVMPassBuilderOptionsRef options = LLVMCreatePassBuilderOptions();
+  exit_on_llvm_error(LLVMRunPasses(ctx->module, passes, ctx->machine, options), "running passes");
+  LLVMDisposePassBuilderOptions(options);
+}
+
+static void reach_function(LLVM_Program *program, bool *reached, THIR *function) {
+  if (function->function.is_extern || reached[function->function.id]) return;
+  reached[function->function.id] = true;
+  vector_push(&program->functions, &function);
+}
 
-  char *target_triple = LLVMGetDefaultTargetTriple();
-  char *features = LLVMGetHostCPUFeatures();
-  char *cpu = LLVMGetHostCPUName();
+static void collect_reached_functions(LLVM_Program *program, bool *reached, THIR *node) {
+  if (!node) return;
+  switch (node->kind) {
+    case THIR_BLOCK:
+      for (u32 i = 0; i < node->statements.length; ++i) {
+        // nested functions are only emitted when something refers to them.
+        if (node->statements.nodes[i]->kind != THIR_FUNCTION) {
+          collect_reached_functions(program, reached, node->statements.nodes[i]);
+        }
+      }
+      break;
+    case THIR_CALL:
+      reach_function(program, reached, node->call.function);
+      for (u32 i = 0; i < node->call.arguments.length; ++i) {
+        collect_reached_functions(program, reached, node->call.arguments.nodes[i]);
+      }
+      break;
+    case THIR_IDENTIFIER:
+      if (node->identifier.resolved->kind == THIR_FUNCTION) {
+        reach_function(program, reached, node->identifier.resolved);
+      }
+      break;
+    case THIR_BINARY_EXPRESSION:
+      collect_reached_functions(program, reached, node->binary.left);
+      collect_reached_functions(program, reached, node->binary.right);
+      break;
+    case THIR_MEMBER_ACCESS:
+      collect_reached_functions(program, reached, node->member_access.base);
+      break;
+    case THIR_RETURN:
+      collect_reached_functions(program, reached, node->return_expression);
+      break;
+    case THIR_VARIABLE_DECLARATION:
+      collect_reached_functions(program, reached, node->variable.value);
+      break;
+    default:
+      break;
+  }
+}
 
-  LLVMSetTarget(ctx->module, target_triple);
+void llvm_session_init(LLVM_Session *session) {
+  *session = (LLVM_Session){0};
+  LLVMInitializeNativeTarget();
+  LLVMInitializeNativeAsmPrinter();
+
+  session->target_triple = LLVMGetDefaultTargetTriple();
+  if (TARGET_ARCH) {
+    // another architecture, with the host's vendor, os & environment.
+    LLVMInitializeAllTargetInfos();
+    LLVMInitializeAllTargets();
+    LLVMInitializeAllTargetMCs();
+    LLVMInitializeAllAsmPrinters();
+    char *rest = strchr(session->target_triple, '-');
+    char triple[strlen(TARGET_ARCH) + (rest ? strlen(rest) : 0) + 1];
+    sprintf(triple, "%s%s", TARGET_ARCH, rest ? rest : "");
+    LLVMDisposeMessage(session->target_triple);
+    session->target_triple = LLVMNormalizeTargetTriple(triple);
+  }
+  // the host's features only mean something for the host's CPU.
+  if (TARGET_ARCH || TARGET_CPU) {
+    session->cpu = LLVMCreateMessage(TARGET_CPU ? TARGET_CPU : "generic");
+    session->features = LLVMCreateMessage("");
+  } else {
+    session->cpu = LLVMGetHostCPUName();
+    session->features = LLVMGetHostCPUFeatures();
+  }
 
-  LLVMTargetRef target;
-  ctx->target = target;
   char *message;
-  if (LLVMGetTargetFromTriple(target_triple, &target, &message)) {
+  if (LLVMGetTargetFromTriple(session->target_triple, &session->target, &message)) {
     fprintf(stderr, "Error getting target from triple: %s\n", message);
     LLVMDisposeMessage(message);
     exit(1);
   }
+}
 
-  LLVMCodeGenOptLevel opt_level = LLVMCodeGenLevelDefault;
+static void dispose_partition_context(LLVM_Emit_Context *ctx) {
+  if (!ctx->context) return;
+  LLVMDisposeBuilder(ctx->alloca_builder);
+  LLVMDisposeBuilder(ctx->builder);
+  if (ctx->thread_safe_context) {
+    LLVMOrcDisposeThreadSafeContext(ctx->thread_safe_context);
+  } else {
+    LLVMContextDispose(ctx->context);
+  }
+  ctx->context = nullptr;
+  ctx->thread_safe_context = nullptr;
+}
 
-  LLVMTargetMachineRef machine =
-      LLVMCreateTargetMachine(target, target_triple, cpu, features, opt_level, LLVMRelocPIC, LLVMCodeModelDefault);
+void llvm_session_free(LLVM_Session *session) {
+  for (size_t i = 0; i < session->context_count; ++i) {
+    LLVM_Emit_Context *ctx = &session->contexts[i];
+    dispose_partition_context(ctx);
+    LLVMDisposeTargetData(ctx->target_data);
+    LLVMDisposeTargetMachine(ctx->machine);
+    vector_free(&ctx->values);
+    hash_index_free(&ctx->values_index);
+    free(ctx->types);
+  }
+  free(session->contexts);
+  LLVMDisposeMessage(session->target_triple);
+  LLVMDisposeMessage(session->features);
+  LLVMDisposeMessage(session->cpu);
+}
+
+// makes sure the session has `count` partition contexts, each with its target machine.
+static void llvm_session_reserve(LLVM_Session *session, size_t count) {
+  if (count <= session->context_count) return;
+  session->contexts = realloc(session->contexts, count * sizeof(LLVM_Emit_Context));
+  for (size_t i = session->context_count; i < count; ++i) {
+    LLVM_Emit_Context *ctx = &session->contexts[i];
+    *ctx = (LLVM_Emit_Context){0};
+    ctx->target = session->target;
+    ctx->machine = LLVMCreateTargetMachine(session->target, session->target_triple, session->cpu, session->features,
+                                           codegen_opt_level(), LLVMRelocPIC, LLVMCodeModelDefault);
+    ctx->target_data = LLVMCreateTargetDataLayout(ctx->machine);
+    vector_init(&ctx->values, sizeof(Emitted_Value));
+    snprintf(ctx->object_path, sizeof(ctx->object_path), "generated/output.%zu.o", i);
+  }
+  session->context_count = count;
+}
+
+static void emit_partition(void *user, size_t index) {
+  LLVM_Program *program = user;
+  LLVM_Emit_Context *ctx = &program->partitions[index];
+
+  // the JIT takes its context over with the module, so a program that's going to be run gets a fresh one.
+  if (EMIT_KIND == EMIT_JIT || !ctx->context) {
+    dispose_partition_context(ctx);
+    if (EMIT_KIND == EMIT_JIT) {
+      ctx->thread_safe_context = LLVMOrcCreateNewThreadSafeContext();
+      ctx->context = LLVMOrcThreadSafeContextGetContext(ctx->thread_safe_context);
+    } else {
+      ctx->context = LLVMContextCreate();
+    }
+    ctx->builder = LLVMCreateBuilderInContext(ctx->context);
+    ctx->alloca_builder = LLVMCreateBuilderInContext(ctx->context);
+  }
+  // type ids start over with every program's type table, so nothing cached for the last one can be reused.
+  size_t type_count = atomic_load(&type_table.length);
+  if (type_count > ctx->type_count) {
+    ctx->types = realloc(ctx->types, type_count * sizeof(LLVMTypeRef));
+    ctx->type_count = type_count;
+  }
+  memset(ctx->types, 0, ctx->type_count * sizeof(LLVMTypeRef));
+
+  char name[32];
+  snprintf(name, sizeof(name), "program.%zu", index);
+  ctx->module = LLVMModuleCreateWithNameInContext(name, ctx->context);
+  LLVMSetTarget(ctx->module, program->session->target_triple);
+  LLVMSetModuleDataLayout(ctx->module, ctx->target_data);
+
+  ctx->functions = calloc(thir_function_count, sizeof(LLVMValueRef));
+  ctx->strings = calloc(string_pool.strings.length, sizeof(LLVMValueRef));
+  // round robin, so every partition gets a share of both the functions near the entry point & the leaves.
+  for (size_t i = index; i < program->functions.length; i += program->partition_count) {
+    emit_thir_function(ctx, V_AT(THIR *, program->functions, i));
+  }
+  free(ctx->functions);
+  free(ctx->strings);
+  ctx->functions = nullptr;
+  ctx->strings = nullptr;
+
+  // O0 only promotes locals to registers, which is most of the win of O1 for a fraction of the time.
+  // a --passes pipeline is used as given, only the built in ones are formatted.
+  char passes[32];
+  if (PASSES) {
+    run_passes(ctx, PASSES);
+  } else if (LTO) {
+    snprintf(passes, sizeof(passes), "lto-pre-link<%s>", opt_level_name());
+    run_passes(ctx, passes);
+  } else if (OPT_LEVEL != OPT_O0) {
+    snprintf(passes, sizeof(passes), "default<%s>", opt_level_name());
+    run_passes(ctx, passes);
+  } else if (DEBUG_MEM2REG) {
+    run_passes(ctx, "function(sroa,mem2reg)");
+  }
+}
 
-  ctx->target_data = LLVMCreateTargetDataLayout(machine);
+void emit_thir_program(LLVM_Session *session, LLVM_Program *program, THIR *thir) {
+  *program = (LLVM_Program){.session = session};
+  vector_init(&program->functions, sizeof(THIR *));
 
-  for (size_t i = 0; i < program->statements.length; ++i) {
-    THIR *node = program->statements.nodes[i];
+  // what the entry point & exports reach, found up front so it can be split before anything is emitted.
+  bool *reached = calloc(thir_function_count, sizeof(bool));
+  for (size_t i = 0; i < thir->statements.length; ++i) {
+    THIR *node = thir->statements.nodes[i];
+    if (node->kind == THIR_FUNCTION && (node->function.is_entry || node->function.is_export)) {
+      reach_function(program, reached, node);
+    }
     if (node->kind == THIR_FUNCTION && node->function.is_entry) {
-      emit_thir_node(ctx, node);
-      break;
+      program->entry = node;
     }
   }
+  // functions found while walking get appended, so this visits each reached body once.
+  for (size_t i = 0; i < program->functions.length; ++i) {
+    collect_reached_functions(program, reached, V_AT(THIR *, program->functions, i)->function.block);
+  }
+  free(reached);
+
+  // textual IR goes to one file, so it comes from one module.
+  size_t partitions = parallel_thread_count();
+  if (partitions > program->functions.length / CODEGEN_MIN_FUNCTIONS_PER_PARTITION) {
+    partitions = program->functions.length / CODEGEN_MIN_FUNCTIONS_PER_PARTITION;
+  }
+  if (!partitions || EMIT_KIND == EMIT_LLVM_IR) {
+    partitions = 1;
+  }
+  llvm_session_reserve(session, partitions);
+  program->partition_count = partitions;
+  program->partitions = session->contexts;
+  parallel_for_each_thread(partitions, program, emit_partition);
+}
 
-  if (COMPILATION_MODE == CM_RELEASE) {
-    const char *passes = "default<O3>";
-    LLVMPassBuilderOptionsRef options = LLVMCreatePassBuilderOptions();
-    LLVMErrorRef pass_error;
-    if ((pass_error = LLVMRunPasses(ctx->module, passes, machine, options))) {
-      char *message = LLVMGetErrorMessage(pass_error);
-      fprintf(stderr, "Error running passes :: %s\n", message);
+static void write_partition_bitcode(void *user, size_t index) {
+  LLVM_Program *program = user;
+  // the first partition is what the rest get linked into.
+  if (index == 0) return;
+  LLVM_Emit_Context *ctx = &program->partitions[index];
+  ctx->bitcode = LLVMWriteBitcodeToMemoryBuffer(ctx->module);
+  LLVMDisposeModule(ctx->module);
+  ctx->module = nullptr;
+}
+
+void merge_emitted_program(LLVM_Program *program) {
+  LLVM_Emit_Context *merged = &program->partitions[0];
+  // contexts can't share anything, so the other partitions go through bitcode to get into the first one's.
+  parallel_for_each_thread(program->partition_count, program, write_partition_bitcode);
+  for (size_t i = 1; i < program->partition_count; ++i) {
+    LLVM_Emit_Context *ctx = &program->partitions[i];
+    LLVMModuleRef module;
+    if (LLVMParseBitcodeInContext2(merged->context, ctx->bitcode, &module)) {
+      fprintf(stderr, "Error reading back the bitcode of partition %zu\n", i);
       exit(1);
     }
-    LLVMDisposePassBuilderOptions(options);
+    LLVMDisposeMemoryBuffer(ctx->bitcode);
+    ctx->bitcode = nullptr;
+    if (LLVMLinkModules2(merged->module, module)) {
+      fprintf(stderr, "Error linking partition %zu\n", i);
+      exit(1);
+    }
+  }
+  program->partition_count = 1;
+
+  if (!LTO) return;
+  // nothing outside the program can call anything but the entry point & the exports.
+  ForEach(THIR *, function, program->functions, {
+    if (!function->function.is_entry && !function->function.is_export) {
+      char symbol[function->function.name.length + 16];
+      LLVMSetLinkage(LLVMGetNamedFunction(merged->module, function_symbol(function, symbol, sizeof(symbol))),
+                     LLVMInternalLinkage);
+    }
+  });
+  char passes[16];
+  snprintf(passes, sizeof(passes), "lto<%s>", opt_level_name());
+  run_passes(merged, passes);
+}
+
+void free_emitted_program(LLVM_Program *program) {
+  for (size_t i = 0; i < program->partition_count; ++i) {
+    LLVM_Emit_Context *ctx = &program->partitions[i];
+    if (ctx->module) {
+      LLVMDisposeModule(ctx->module);
+      ctx->module = nullptr;
+    }
   }
+  vector_free(&program->functions);
+}
 
-  char *error;
-  if (LLVMPrintModuleToFile(ctx->module, "generated/output.ll", &error)) {
-    printf("%s\n", error);
+static void write_partition(void *user, size_t index) {
+  LLVM_Program *program = user;
+  LLVM_Emit_Context *ctx = &program->partitions[index];
+  char *error = nullptr;
+  bool failed;
+  switch (EMIT_KIND) {
+    case EMIT_OBJECT:
+      // codegen straight from the in-memory module, no textual IR for clang to parse again.
+      failed = LLVMTargetMachineEmitToFile(ctx->machine, ctx->module, ctx->object_path, LLVMObjectFile, &error);
+      break;
+    case EMIT_LLVM_IR:
+      failed = LLVMPrintModuleToFile(ctx->module, "generated/output.ll", &error);
+      break;
+    case EMIT_BITCODE:
+      failed = LLVMWriteBitcodeToFile(ctx->module, "generated/output.bc");
+      break;
+    case EMIT_JIT:
+      panic("write_emitted_program called on a program that's going to be JIT compiled");
+      return;
+  }
+  if (failed) {
+    fprintf(stderr, "Error writing output :: %s\n", error ? error : "can't write generated/output.bc");
     exit(1);
   }
+  LLVMDisposeModule(ctx->module);
+  ctx->module = nullptr;
+}
 
-  LLVMDisposeMessage(target_triple);
-  LLVMDisposeMessage(features);
-  LLVMDisposeMessage(cpu);
-  LLVMContextDispose(ctx->context);
-  return nullptr;
+void write_emitted_program(LLVM_Program *program) {
+  parallel_for_each_thread(program->partition_count, program, write_partition);
+}
+
+int link_emitted_program(LLVM_Program *program, const char *output) {
+  size_t length = 64 + strlen(output);
+  for (size_t i = 0; i < program->partition_count; ++i) {
+    length += strlen(program->partitions[i].object_path) + 1;
+  }
+  char *command = malloc(length);
+  char *cursor = command + sprintf(command, "clang -g");
+  for (size_t i = 0; i < program->partition_count; ++i) {
+    cursor += sprintf(cursor, " %s", program->partitions[i].object_path);
+  }
+  sprintf(cursor, " -o %s", output);
+  int status = system(command);
+  free(command);
+  return status;
+}
+
+int run_emitted_program(LLVM_Program *program) {
+  THIR *entry = program->entry;
+  if (!entry) {
+    fprintf(stderr, "--run needs an @entry function\n");
+    exit(1);
+  }
+
+  LLVMOrcLLJITRef jit;
+  exit_on_llvm_error(LLVMOrcCreateLLJIT(&jit, nullptr), "creating the JIT");
+  LLVMOrcJITDylibRef dylib = LLVMOrcLLJITGetMainJITDylib(jit);
+
+  // @extern functions (printf & co) resolve to whatever this process has linked in.
+  LLVMOrcDefinitionGeneratorRef process_symbols;
+  exit_on_llvm_error(LLVMOrcCreateDynamicLibrarySearchGeneratorForProcess(
+                         &process_symbols, LLVMOrcLLJITGetGlobalPrefix(jit), nullptr, nullptr),
+                     "looking up the process' symbols");
+  LLVMOrcJITDylibAddGenerator(dylib, process_symbols);
+
+  // the JIT takes the modules & their contexts over from here, and resolves the calls between them.
+  for (size_t i = 0; i < program->partition_count; ++i) {
+    LLVM_Emit_Context *ctx = &program->partitions[i];
+    LLVMOrcThreadSafeModuleRef module = LLVMOrcCreateNewThreadSafeModule(ctx->module, ctx->thread_safe_context);
+    ctx->module = nullptr;
+    dispose_partition_context(ctx);
+    exit_on_llvm_error(LLVMOrcLLJITAddLLVMIRModule(jit, dylib, module), "adding a module to the JIT");
+  }
+
+  LLVMOrcExecutorAddress address;
+  exit_on_llvm_error(LLVMOrcLLJITLookup(jit, &address, entry->function.name.data), "compiling the entry point");
+
+  int status = 0;
+  if (get_type(get_type(entry->type)->$function.$return)->kind == VOID) {
+    ((void (*)(void))address)();
+  } else {
+    status = ((int (*)(void))address)();
+  }
+  fflush(stdout);
+
+  free_emitted_program(program);
+  exit_on_llvm_error(LLVMOrcDisposeLLJIT(jit), "tearing down the JIT");
+  return status;
+}
+
+static void add_function_attribute(LLVM_Emit_Context *ctx, LLVMValueRef function, const char *name) {
+  unsigned kind = LLVMGetEnumAttributeKindForName(name, strlen(name));
+  LLVMAddAttributeAtIndex(function, LLVMAttributeFunctionIndex, LLVMCreateEnumAttribute(ctx->context, kind, 0));
+}
+
+// declarations get them too, so whatever calls a function from another partition knows it's cold.
+static void add_function_attributes(LLVM_Emit_Context *ctx, THIR *node, LLVMValueRef function) {
+  // LLVM won't run anything over an optnone function, and insists it's noinline as well.
+  if (node->function.is_optnone) {
+    add_function_attribute(ctx, function, "optnone");
+  }
+  if (node->function.is_noinline || node->function.is_optnone) {
+    add_function_attribute(ctx, function, "noinline");
+  } else if (node->function.is_inline) {
+    add_function_attribute(ctx, function, "inlinehint");
+  }
+  if (node->function.is_cold) {
+    add_function_attribute(ctx, function, "cold");
+  }
+  // -Os & -Oz are about the functions as much as the pipeline, codegen only looks at the attributes.
+  if (node->function.is_minsize || OPT_LEVEL == OPT_OZ) {
+    add_function_attribute(ctx, function, "minsize");
+  }
+  if (node->function.is_minsize || OPT_LEVEL == OPT_OZ || OPT_LEVEL == OPT_OS) {
+    add_function_attribute(ctx, function, "optsize");
+  }
 }
 
 LLVMValueRef emit_thir_function_forward_declaration(LLVM_Emit_Context *ctx, THIR *node) {
-  if (node->function.llvm_function) {
-    return node->function.llvm_function;
+  if (ctx->functions[node->function.id]) {
+    return ctx->functions[node->function.id];
   }
   Type *fn_ty = get_type(node->type);
   LLVMTypeRef return_type = to_llvm_type(ctx, get_type(fn_ty->$function.$return));
@@ -212,25 +568,26 @@ LLVMValueRef emit_thir_function_forward_declaration(LLVM_Emit_Context *ctx, THIR
   if (parameters_length > 0) {
     param_types = (LLVMTypeRef *)malloc(sizeof(LLVMTypeRef) * parameters_length);
     for (int i = 0; i < parameters_length; ++i) {
-      THIRParameter parameter = V_AT(THIRParameter, node->function.parameters, i);
-      if (parameter.is_vararg) {
+      THIR *parameter = node->function.parameters.nodes[i];
+      if (parameter->parameter.is_vararg) {
         is_varargs = true;
         parameters_length--;
         break;
       } else {
-        param_types[i] = to_llvm_type(ctx, get_type(parameter.type));
+        param_types[i] = to_llvm_type(ctx, get_type(parameter->type));
       }
     }
   }
 
   LLVMTypeRef function_type = LLVMFunctionType(return_type, param_types, parameters_length, is_varargs);
 
-  LLVMValueRef function = LLVMGetNamedFunction(ctx->module, node->function.name.data);
-  if (!function) {
-    function = LLVMAddFunction(ctx->module, node->function.name.data, function_type);
+  char symbol[node->function.name.length + 16];
+  LLVMValueRef function =
+      LLVMAddFunction(ctx->module, function_symbol(node, symbol, sizeof(symbol)), function_type);
+  ctx->functions[node->function.id] = function;
+  if (!node->function.is_extern) {
+    add_function_attributes(ctx, node, function);
   }
-  
-  node->function.llvm_function = function;
 
   if (param_types) {
     free(param_types);
@@ -243,18 +600,34 @@ LLVMValueRef emit_thir_function(LLVM_Emit_Context *ctx, THIR *node) {
 
   LLVMValueRef function = emit_thir_function_forward_declaration(ctx, node);
 
-  if (node->function.is_extern) {
+  // extern, or the body was already emitted.
+  if (node->function.is_extern || LLVMCountBasicBlocks(function)) {
     return function;
   }
 
+  double start = time_now();
   LLVMBasicBlockRef entry = LLVMAppendBasicBlockInContext(ctx->context, function, "entry");
   LLVMPositionBuilderAtEnd(ctx->builder, entry);
+  ctx->function = function;
+  ctx->values.length = 0;
+  hash_index_clear(&ctx->values_index);
+
+  // parameters get a slot like any local, so they can be assigned to and have their members accessed.
+  for (u32 i = 0; i < node->function.parameters.length; ++i) {
+    THIR *parameter = node->function.parameters.nodes[i];
+    if (parameter->parameter.is_vararg) break;
+    LLVMValueRef slot = emit_entry_alloca(ctx, to_llvm_type(ctx, get_type(parameter->type)),
+                                          parameter->parameter.name.length ? parameter->parameter.name.data : "");
+    LLVMBuildStore(ctx->builder, LLVMGetParam(function, i), slot);
+    insert_emitted_value(ctx, parameter, slot);
+  }
+
   emit_thir_node(ctx, node->function.block);
   Type *fn_type = get_type(node->type);
   if (fn_type->$function.$return == VOID) {
     LLVMBuildRetVoid(ctx->builder);
   }
-  node->function.llvm_function = function;
+  node->function.emission_time = TIME_DIFF(start, time_now());
   return nullptr;
 }
 
@@ -265,8 +638,8 @@ LLVMValueRef emit_thir_type_declaration(LLVM_Emit_Context *ctx, THIR *node) {
 
 LLVMValueRef emit_thir_variable_declaration(LLVM_Emit_Context *ctx, THIR *node) {
   LLVMTypeRef var_type = to_llvm_type(ctx, get_type(node->type));
-  LLVMValueRef var = LLVMBuildAlloca(ctx->builder, var_type, node->variable.name.data);
-  // TODO: Store LLVMValueRef in your symbol table for this variable
+  LLVMValueRef var = emit_entry_alloca(ctx, var_type, node->variable.name.data);
+  insert_emitted_value(ctx, node, var);
 
   if (node->variable.value) {
     LLVMValueRef init = emit_thir_node(ctx, node->variable.value);
@@ -276,31 +649,54 @@ LLVMValueRef emit_thir_variable_declaration(LLVM_Emit_Context *ctx, THIR *node)
 }
 
 LLVMValueRef emit_thir_identifier(LLVM_Emit_Context *ctx, THIR *node) {
-  // TODO: Lookup symbol in your THIR symbol table
-  LLVMValueRef value = emit_thir_node(ctx, node->identifier.resolved);
-  LLVMTypeRef llvm_type = to_llvm_type(ctx, get_type(node->type));
+  THIR *resolved = node->identifier.resolved;
+  if (resolved->kind == THIR_FUNCTION) {
+    return emit_thir_function_forward_declaration(ctx, resolved);
+  }
+
+  // locals & parameters were given their slot where they're declared.
+  String name = resolved->kind == THIR_PARAMETER ? resolved->parameter.name : resolved->variable.name;
+  LLVMValueRef slot = find_emitted_value(ctx, resolved);
+  if (!slot) {
+    fprintf(stderr, "'%.*s' used before its declaration was emitted\n", (int)name.length, name.data);
+    exit(1);
+  }
   if (ctx->dont_load) {
-    return value;
-  } else {
-    return LLVMBuildLoad2(ctx->builder, llvm_type, value, node->identifier.name.data);
+    return slot;
   }
+  return LLVMBuildLoad2(ctx->builder, to_llvm_type(ctx, get_type(node->type)), slot, name.data);
 }
 
 LLVMValueRef emit_thir_number(LLVM_Emit_Context *ctx, THIR *node) {
-  return LLVMConstInt(LLVMInt32Type(), atoll(node->number.data), false);
+  // already parsed & range checked, this only picks the width.
+  return LLVMConstInt(to_llvm_type(ctx, get_type(node->type)), node->number, !type_is_unsigned(node->type));
 }
 
 LLVMValueRef emit_thir_string(LLVM_Emit_Context *ctx, THIR *node) {
-  char *encoded_str = unescape_string_lit(node->string.data);
-  LLVMValueRef result = LLVMBuildGlobalString(ctx->builder, encoded_str, "str");
-  free(encoded_str);
-  return result;
+  u32 id = node->string.id;
+  if (ctx->strings[id]) {
+    return ctx->strings[id];
+  }
+  String value = node->string.value;
+  LLVMValueRef initializer = LLVMConstStringInContext(ctx->context, value.data, value.length, false);
+  LLVMValueRef global = LLVMAddGlobal(ctx->module, LLVMTypeOf(initializer), "str");
+  LLVMSetInitializer(global, initializer);
+  LLVMSetGlobalConstant(global, true);
+  LLVMSetLinkage(global, LLVMPrivateLinkage);
+  LLVMSetUnnamedAddress(global, LLVMGlobalUnnamedAddr);
+  LLVMSetAlignment(global, 1);
+
+  // a String is a pointer to the first character.
+  LLVMValueRef zero = LLVMConstInt(LLVMInt32TypeInContext(ctx->context), 0, false);
+  LLVMValueRef indices[] = {zero, zero};
+  ctx->strings[id] = LLVMConstInBoundsGEP2(LLVMTypeOf(initializer), global, indices, 2);
+  return ctx->strings[id];
 }
 
 LLVMValueRef emit_thir_member_access(LLVM_Emit_Context *ctx, THIR *node) {
   DONT_LOAD(old_state, ctx, LLVMValueRef left = emit_thir_node(ctx, node->member_access.base);)
   Type *left_type = get_type(node->member_access.base->type);
-  size_t member_index = get_member_index(left_type, node->member_access.member);
+  u32 member_index = node->member_access.index;
   Type *member_type = get_type(V_AT(Type_Member, left_type->$struct.members, member_index).type);
   LLVMValueRef gep = LLVMBuildStructGEP2(ctx->builder, to_llvm_type(ctx, left_type), left, member_index, "dotexpr");
 
@@ -314,12 +710,22 @@ LLVMValueRef emit_thir_member_access(LLVM_Emit_Context *ctx, THIR *node) {
 }
 
 LLVMValueRef emit_thir_call(LLVM_Emit_Context *ctx, THIR *node) {
-  LLVMValueRef function = emit_thir_node(ctx, node->call.function);
+  // only declare the callee here, its body is emitted by whichever partition it was given to.
+  LLVMValueRef function = emit_thir_function_forward_declaration(ctx, node->call.function);
 
   size_t argc = node->call.arguments.length;
+  size_t fixed = get_type(node->call.function->type)->$function.parameters.length;
   LLVMValueRef args[argc];
   for (size_t i = 0; i < argc; ++i) {
-    args[i] = emit_thir_node(ctx, node->call.arguments.nodes[i]);
+    THIR *argument = node->call.arguments.nodes[i];
+    args[i] = emit_thir_node(ctx, argument);
+    // C's default argument promotions, anything narrower than an int is passed through `...` as one.
+    u32 bits = type_integer_bits(argument->type);
+    if (i >= fixed && bits && bits < 32) {
+      LLVMTypeRef i32 = LLVMInt32TypeInContext(ctx->context);
+      args[i] = type_is_unsigned(argument->type) ? LLVMBuildZExt(ctx->builder, args[i], i32, "promoted")
+                                                 : LLVMBuildSExt(ctx->builder, args[i], i32, "promoted");
+    }
   }
   LLVMTypeRef fn_type = to_llvm_type(ctx, get_type(node->call.function->type));
   LLVMValueRef call = LLVMBuildCall2(ctx->builder, fn_type, function, args, argc, "");
@@ -336,6 +742,7 @@ LLVMValueRef emit_thir_binary_expression(LLVM_Emit_Context *ctx, THIR *node) {
 
   LLVMValueRef left = emit_thir_node(ctx, node->binary.left);
   LLVMValueRef right = emit_thir_node(ctx, node->binary.right);
+  bool is_unsigned = type_is_unsigned(node->binary.left->type);
 
   LLVMValueRef result;
   switch (node->binary.operator) {
@@ -349,10 +756,12 @@ LLVMValueRef emit_thir_binary_expression(LLVM_Emit_Context *ctx, THIR *node) {
       result = LLVMBuildMul(ctx->builder, left, right, "multmp");
       break;
     case TOKEN_DIV:
-      result = LLVMBuildSDiv(ctx->builder, left, right, "divtmp");
+      result = is_unsigned ? LLVMBuildUDiv(ctx->builder, left, right, "divtmp")
+                           : LLVMBuildSDiv(ctx->builder, left, right, "divtmp");
       break;
     case TOKEN_MOD:
-      result = LLVMBuildSRem(ctx->builder, left, right, "modtmp");
+      result = is_unsigned ? LLVMBuildURem(ctx->builder, left, right, "modtmp")
+                           : LLVMBuildSRem(ctx->builder, left, right, "modtmp");
       break;
     case TOKEN_AND:
       result = LLVMBuildAnd(ctx->builder, left, right, "andtmp");
@@ -376,21 +785,25 @@ LLVMValueRef emit_thir_binary_expression(LLVM_Emit_Context *ctx, THIR *node) {
       result = LLVMBuildICmp(ctx->builder, LLVMIntNE, left, right, "neqtmp");
       break;
     case TOKEN_LT:
-      result = LLVMBuildICmp(ctx->builder, LLVMIntSLT, left, right, "lttmp");
+      result = LLVMBuildICmp(ctx->builder, is_unsigned ? LLVMIntULT : LLVMIntSLT, left, right, "lttmp");
       break;
     case TOKEN_GT:
-      result = LLVMBuildICmp(ctx->builder, LLVMIntSGT, left, right, "gttmp");
+      result = LLVMBuildICmp(ctx->builder, is_unsigned ? LLVMIntUGT : LLVMIntSGT, left, right, "gttmp");
       break;
     case TOKEN_LTE:
-      result = LLVMBuildICmp(ctx->builder, LLVMIntSLE, left, right, "ltetmp");
+      result = LLVMBuildICmp(ctx->builder, is_unsigned ? LLVMIntULE : LLVMIntSLE, left, right, "ltetmp");
       break;
     case TOKEN_GTE:
-      result = LLVMBuildICmp(ctx->builder, LLVMIntSGE, left, right, "gtetmp");
+      result = LLVMBuildICmp(ctx->builder, is_unsigned ? LLVMIntUGE : LLVMIntSGE, left, right, "gtetmp");
       break;
     default:
       fprintf(stderr, "Unknown binary operator: %d\n", node->binary.operator);
       exit(1);
   }
+  // comparisons are typed as their operands, 0 or 1 like the constant folder makes them, not LLVM's i1.
+  if (LLVMTypeOf(result) != LLVMTypeOf(left)) {
+    result = LLVMBuildZExt(ctx->builder, result, to_llvm_type(ctx, get_type(node->type)), "booltmp");
+  }
   return result;
 }
 
@@ -406,15 +819,16 @@ LLVMValueRef emit_thir_return(LLVM_Emit_Context *ctx, THIR *node) {
 
 LLVMValueRef emit_thir_block(LLVM_Emit_Context *ctx, THIR *node) {
   for (size_t i = 0; i < node->statements.length; ++i) {
-    emit_thir_node(ctx, node->statements.nodes[i]);
+    THIR *statement = node->statements.nodes[i];
+    // nested functions are emitted once something calls them, like any other, not in the middle of this one.
+    if (statement->kind == THIR_FUNCTION) continue;
+    emit_thir_node(ctx, statement);
   }
   return nullptr;
 }
 
 LLVMValueRef emit_thir_node(LLVM_Emit_Context *ctx, THIR *node) {
   switch (node->kind) {
-    case THIR_PROGRAM:
-      return emit_thir_program(ctx, node);
     case THIR_BLOCK:
       return emit_thir_block(ctx, node);
     case THIR_TYPE_DECLARATION:
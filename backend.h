@@ -3,23 +3,96 @@
 
 #include "thir.h"
 #include "llvm-c/Types.h"
+#include <llvm-c/Orc.h>
 #include <llvm-c/TargetMachine.h>
 
+typedef struct {
+  THIR *node;
+  LLVMValueRef value;
+} Emitted_Value;
+
 typedef struct LLVM_Emit_Context {
   LLVMBuilderRef builder;
+  // kept at the top of the current function's entry block, where every local's alloca goes.
+  LLVMBuilderRef alloca_builder;
   LLVMModuleRef module;
   LLVMContextRef context;
+  // owns `context` when the program is going to be JIT compiled, which has to hand the module over with it.
+  LLVMOrcThreadSafeContextRef thread_safe_context;
+  // indexed by type id. LLVM types belong to a context, so every partition builds its own. type ids are only
+  // unique within a program, so it's cleared for each one emitted, the buffer is what's kept.
+  LLVMTypeRef *types;
+  size_t type_count;
   LLVMDIBuilderRef di_builder;
   LLVMMetadataRef di_file;
   LLVMTargetRef target;
+  LLVMTargetMachineRef machine;
   LLVMTargetDataRef target_data;
   bool dont_load;
   LLVMMetadataRef scope;
+  // indexed by THIR function id, the declarations & definitions in this partition's module.
+  LLVMValueRef *functions;
+  // indexed by string pool id, a pointer to each string's constant in this partition's module.
+  LLVMValueRef *strings;
+  // the function whose body is being emitted.
+  LLVMValueRef function;
+  // what the function being emitted made of its locals & parameters (their alloca), so every use refers to
+  // the one value instead of emitting the declaration again.
+  Hash_Index values_index; // hash of the THIR * -> index into values.
+  Vector values;           // Vector<Emitted_Value>
+  // where write_emitted_program puts this partition's object.
+  char object_path[64];
+  // the module, while it's on its way to being merged into another partition's context.
+  LLVMMemoryBufferRef bitcode;
 } LLVM_Emit_Context;
 
+// minimum number of function bodies worth giving a module & thread of their own.
+#define CODEGEN_MIN_FUNCTIONS_PER_PARTITION 64
+
+// What outlives a single compilation: the target, and a context per partition with its builders, target machine
+// and type cache buffer, all set up the first time they're needed & reused by every program emitted after that.
+// Programs that are going to be JIT compiled still get fresh contexts, the JIT keeps the ones it's given.
+typedef struct {
+  char *target_triple;
+  char *cpu;
+  char *features;
+  LLVMTargetRef target;
+  LLVM_Emit_Context *contexts;
+  size_t context_count;
+} LLVM_Session;
+
+// The program's function bodies are split across partitions, each its own context & module that is emitted,
+// optimized and compiled on its own thread. Calls into another partition are only declared, the linker
+// (or the JIT) resolves them, so nothing is shared between partitions but the THIR they read.
+typedef struct {
+  LLVM_Session *session;
+  // the first partition_count of the session's contexts.
+  LLVM_Emit_Context *partitions;
+  size_t partition_count;
+  // Vector<THIR *>, every function with a body the entry point & exports reach, in the order they're reached.
+  Vector functions;
+  // the @entry function, if the program has one.
+  THIR *entry;
+} LLVM_Program;
+
+// initializes LLVM for the target -march & -mcpu ask for, the host's by default.
+void llvm_session_init(LLVM_Session *session);
+void llvm_session_free(LLVM_Session *session);
+
 // THIR-based LLVM emission API
 LLVMValueRef emit_thir_node(LLVM_Emit_Context *ctx, THIR *node);
-LLVMValueRef emit_thir_program(LLVM_Emit_Context *ctx, THIR *program);
+// emits & optimizes the whole program into the partitions' modules.
+void emit_thir_program(LLVM_Session *session, LLVM_Program *program, THIR *thir);
+// links every partition into the first one's module, then with LTO runs the whole program through the LTO pipeline.
+void merge_emitted_program(LLVM_Program *program);
+// writes the modules emit_thir_program made as EMIT_KIND asks, straight from memory, then frees them.
+void write_emitted_program(LLVM_Program *program);
+// links the objects write_emitted_program wrote into `output`, returns the linker's exit status.
+int link_emitted_program(LLVM_Program *program, const char *output);
+// frees what's left of the program once its output has been written & linked, the session's contexts stay.
+void free_emitted_program(LLVM_Program *program);
+// JIT compiles the modules, calls the entry point and returns what it returned (0 for void), then frees it all.
+int run_emitted_program(LLVM_Program *program);
 LLVMValueRef emit_thir_function_forward_declaration(LLVM_Emit_Context *ctx, THIR *node);
 LLVMValueRef emit_thir_function(LLVM_Emit_Context *ctx, THIR *node);
 LLVMValueRef emit_thir_type_declaration(LLVM_Emit_Context *ctx, THIR *node);
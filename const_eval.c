@@ -0,0 +1,336 @@
+#include "const_eval.h"
+#include "core.h"
+#include "query.h"
+#include "thir.h"
+#include "type.h"
+
+void const_eval_init(Const_Evaluator *evaluator) {
+  *evaluator = (Const_Evaluator){0};
+  vector_init(&evaluator->stack, sizeof(Const_Slot));
+  vector_init(&evaluator->memo, sizeof(Const_Memo));
+  arena_init(&evaluator->arena);
+}
+
+void const_eval_free(Const_Evaluator *evaluator) {
+  vector_free(&evaluator->stack);
+  vector_free(&evaluator->memo);
+  hash_index_free(&evaluator->memo_index);
+  arena_free(&evaluator->arena);
+}
+
+u32 const_eval_integer_bits(size_t type) {
+  return type_integer_bits(type);
+}
+
+// signed values are sign extended from their width, unsigned ones zero extended.
+static s64 const_eval_truncate(size_t type, s64 value) {
+  u32 bits = type_integer_bits(type);
+  u64 sign = (u64)1 << (bits - 1);
+  u64 truncated = (u64)value & ((sign << 1) - 1);
+  if (type_is_unsigned(type)) return (s64)truncated;
+  return (s64)((truncated ^ sign) - sign);
+}
+
+static s64 const_eval_wrap(size_t type, s64 value, Source_Location location) {
+  if (!const_eval_integer_bits(type)) {
+    parse_panicf(location, "values of type '%s' can't be computed at compile time",
+                 type_to_string(get_type(type)).data);
+  }
+  return const_eval_truncate(type, value);
+}
+
+static u64 const_eval_memo_hash(u32 function, s64 *arguments, u32 argument_count) {
+  return hash_bytes(arguments, argument_count * sizeof(s64)) ^ ((u64)function * 0x9e3779b97f4a7c15ull);
+}
+
+static Const_Slot *const_eval_find_slot(Const_Evaluator *evaluator, THIR *declaration) {
+  // newest first, locals only ever come from the current call.
+  for (size_t i = evaluator->stack.length; i > evaluator->frame; --i) {
+    Const_Slot *slot = V_PTR_AT(Const_Slot, evaluator->stack, i - 1);
+    if (slot->declaration == declaration) {
+      return slot;
+    }
+  }
+  return nullptr;
+}
+
+static void const_eval_push_slot(Const_Evaluator *evaluator, THIR *declaration, s64 value) {
+  vector_push(&evaluator->stack, &(Const_Slot){.declaration = declaration, .value = value});
+  size_t memory = evaluator->stack.length * sizeof(Const_Slot) + evaluator->depth * CONST_EVAL_FRAME_COST;
+  if (memory > CONST_EVAL_MEMORY_BUDGET) {
+    parse_panicf(declaration->location, "compile time evaluation exceeded its memory budget of %d bytes",
+                 CONST_EVAL_MEMORY_BUDGET);
+  }
+}
+
+static s64 const_eval_node(Query_Engine *engine, THIR *node);
+
+static s64 const_eval_call(Query_Engine *engine, THIR *function, s64 *arguments, Source_Location location) {
+  Const_Evaluator *evaluator = &engine->const_eval;
+  u32 argument_count = function->function.parameters.length;
+  evaluator->calls++;
+
+  size_t cursor = 0, index;
+  u64 hash = const_eval_memo_hash(function->function.id, arguments, argument_count);
+  while ((index = hash_index_next(&evaluator->memo_index, hash, &cursor)) != HASH_INDEX_END) {
+    Const_Memo *memo = V_PTR_AT(Const_Memo, evaluator->memo, index);
+    if (memo->function == function->function.id &&
+        memcmp(memo->arguments, arguments, argument_count * sizeof(s64)) == 0) {
+      evaluator->memo_hits++;
+      return memo->result;
+    }
+  }
+
+  if (!function->function.block) {
+    AST *declaration = function->function.declaration;
+    Instance *instance = function->function.instance;
+    Query *body = query_find(engine, QUERY_BODY_THIR, declaration, instance);
+    if (query_is_running_here(engine, body)) {
+      parse_panicf(location, "'%s' can't be evaluated at compile time from inside its own body",
+                   function->function.name.data);
+    }
+    query_body_thir(engine, declaration, instance);
+  }
+
+  size_t frame = evaluator->frame;
+  evaluator->frame = evaluator->stack.length;
+  evaluator->depth++;
+  for (u32 i = 0; i < argument_count; ++i) {
+    const_eval_push_slot(evaluator, function->function.parameters.nodes[i], arguments[i]);
+  }
+
+  const_eval_node(engine, function->function.block);
+  s64 result = evaluator->returning ? evaluator->return_value : 0;
+  evaluator->returning = false;
+
+  evaluator->stack.length = evaluator->frame;
+  evaluator->frame = frame;
+  evaluator->depth--;
+
+  s64 *saved = argument_count ? ARENA_ALLOC_ARRAY(&evaluator->arena, s64, argument_count) : nullptr;
+  memcpy(saved, arguments, argument_count * sizeof(s64));
+  hash_index_insert(&evaluator->memo_index, hash, evaluator->memo.length);
+  vector_push(&evaluator->memo, &(Const_Memo){
+                                    .function = function->function.id,
+                                    .argument_count = argument_count,
+                                    .arguments = saved,
+                                    .result = result,
+                                });
+  return result;
+}
+
+const char *const_eval_binary(Token_Type operator, size_t type, s64 left, s64 right, s64 *result) {
+  u32 bits = const_eval_integer_bits(type);
+  if (!bits) {
+    return "only integers can be computed at compile time";
+  }
+  bool is_unsigned = type_is_unsigned(type);
+  left = const_eval_truncate(type, left);
+  right = const_eval_truncate(type, right);
+
+  s64 value;
+  switch (operator) {
+    case TOKEN_ADD:
+      value = (u64)left + (u64)right;
+      break;
+    case TOKEN_SUB:
+      value = (u64)left - (u64)right;
+      break;
+    case TOKEN_MUL:
+      value = (u64)left * (u64)right;
+      break;
+    case TOKEN_DIV:
+    case TOKEN_MOD:
+      // both trap at runtime.
+      if (right == 0) {
+        return "division by zero";
+      }
+      if (is_unsigned) {
+        value = operator == TOKEN_DIV ? (u64)left / (u64)right : (u64)left % (u64)right;
+        break;
+      }
+      if (right == -1 && left == (s64)((u64)-1 << (bits - 1))) {
+        return "signed overflow in division";
+      }
+      value = operator == TOKEN_DIV ? left / right : left % right;
+      break;
+    case TOKEN_AND:
+      value = left & right;
+      break;
+    case TOKEN_OR:
+      value = left | right;
+      break;
+    case TOKEN_XOR:
+      value = left ^ right;
+      break;
+    case TOKEN_SHL:
+    case TOKEN_SHR:
+      // poison in LLVM.
+      if ((u64)right >= bits) {
+        return "shift amount out of range";
+      }
+      if (operator == TOKEN_SHL) {
+        value = (u64)left << right;
+      } else {
+        // logical, like the backend.
+        value = (s64)(((u64)left & ((u64)-1 >> (64 - bits))) >> right);
+      }
+      break;
+    case TOKEN_EQ:
+      value = left == right;
+      break;
+    case TOKEN_NEQ:
+      value = left != right;
+      break;
+    case TOKEN_LT:
+      value = is_unsigned ? (u64)left < (u64)right : left < right;
+      break;
+    case TOKEN_GT:
+      value = is_unsigned ? (u64)left > (u64)right : left > right;
+      break;
+    case TOKEN_LTE:
+      value = is_unsigned ? (u64)left <= (u64)right : left <= right;
+      break;
+    case TOKEN_GTE:
+      value = is_unsigned ? (u64)left >= (u64)right : left >= right;
+      break;
+    default:
+      return "unsupported operator";
+  }
+  *result = const_eval_truncate(type, value);
+  return nullptr;
+}
+
+static s64 const_eval_node(Query_Engine *engine, THIR *node) {
+  Const_Evaluator *evaluator = &engine->const_eval;
+  if (++evaluator->steps > CONST_EVAL_STEP_BUDGET) {
+    parse_panicf(node->location, "compile time evaluation exceeded its budget of %d steps", CONST_EVAL_STEP_BUDGET);
+  }
+
+  switch (node->kind) {
+    case THIR_NUMBER:
+      return const_eval_wrap(node->type, node->number, node->location);
+    case THIR_IDENTIFIER: {
+      THIR *resolved = node->identifier.resolved;
+      Const_Slot *slot = const_eval_find_slot(evaluator, resolved);
+      if (slot) {
+        return slot->value;
+      }
+      if (resolved->kind == THIR_VARIABLE_DECLARATION && resolved->variable.is_const) {
+        return resolved->variable.value->number;
+      }
+      String name = resolved->kind == THIR_PARAMETER ? resolved->parameter.name : resolved->variable.name;
+      parse_panicf(node->location, "'%s' is not known at compile time", name.data);
+    }
+    case THIR_BINARY_EXPRESSION: {
+      if (node->binary.operator == TOKEN_ASSIGN) {
+        // the value first, evaluating it can grow the stack and move the slot.
+        s64 value = const_eval_node(engine, node->binary.right);
+        THIR *target = node->binary.left;
+        Const_Slot *slot =
+            target->kind == THIR_IDENTIFIER ? const_eval_find_slot(evaluator, target->identifier.resolved) : nullptr;
+        if (!slot) {
+          parse_panic(node->location, "only locals can be assigned in compile time evaluation");
+        }
+        slot->value = value;
+        return 0;
+      }
+      s64 left = const_eval_node(engine, node->binary.left);
+      s64 right = const_eval_node(engine, node->binary.right);
+      s64 result;
+      const char *error = const_eval_binary(node->binary.operator, node->type, left, right, &result);
+      if (error) {
+        parse_panicf(node->location, "%s in compile time evaluation", error);
+      }
+      return result;
+    }
+    case THIR_CALL: {
+      THIR *function = node->call.function;
+      if (!function->function.is_const) {
+        parse_panicf(node->location, "call to non-@const function '%s' in compile time evaluation",
+                     function->function.name.data);
+      }
+      u32 argument_count = node->call.arguments.length;
+      s64 arguments[argument_count + 1];
+      for (u32 i = 0; i < argument_count; ++i) {
+        arguments[i] = const_eval_node(engine, node->call.arguments.nodes[i]);
+      }
+      return const_eval_call(engine, function, arguments, node->location);
+    }
+    case THIR_BLOCK:
+      for (u32 i = 0; i < node->statements.length && !evaluator->returning; ++i) {
+        THIR *statement = node->statements.nodes[i];
+        // nested declarations don't do anything when they're reached.
+        if (statement->kind != THIR_FUNCTION && statement->kind != THIR_TYPE_DECLARATION) {
+          const_eval_node(engine, statement);
+        }
+      }
+      return 0;
+    case THIR_RETURN:
+      evaluator->return_value = node->return_expression ? const_eval_node(engine, node->return_expression) : 0;
+      evaluator->returning = true;
+      return 0;
+    case THIR_VARIABLE_DECLARATION: {
+      s64 value = node->variable.value ? const_eval_node(engine, node->variable.value) : 0;
+      const_eval_push_slot(evaluator, node, value);
+      return 0;
+    }
+    default:
+      parse_panicf(node->location, "%s can't be evaluated at compile time", thir_kind_to_string(node->kind));
+  }
+}
+
+s64 const_eval_expression(Query_Engine *engine, THIR *expression) {
+  Const_Evaluator *evaluator = &engine->const_eval;
+  // one evaluator for the whole program, bodies typed in parallel take turns.
+  query_lock(engine);
+  double start = time_now();
+  evaluator->evaluations++;
+  evaluator->active++;
+
+  // typing a callee's body can reach another @const, which gets evaluated from inside this one,
+  // with its own budget & without seeing the locals of the call that's running.
+  size_t frame = evaluator->frame;
+  u64 steps = evaluator->steps;
+  evaluator->frame = evaluator->stack.length;
+  evaluator->steps = 0;
+
+  s64 value = const_eval_node(engine, expression);
+
+  evaluator->total_steps += evaluator->steps;
+  evaluator->frame = frame;
+  evaluator->steps = steps;
+  if (--evaluator->active == 0) {
+    evaluator->time += time_now() - start;
+  }
+  query_unlock(engine);
+  return value;
+}
+
+bool const_eval_is_constant(THIR *expression) {
+  switch (expression->kind) {
+    case THIR_NUMBER:
+      return true;
+    case THIR_IDENTIFIER: {
+      THIR *resolved = expression->identifier.resolved;
+      return resolved->kind == THIR_VARIABLE_DECLARATION && resolved->variable.is_const;
+    }
+    case THIR_BINARY_EXPRESSION:
+      return expression->binary.operator != TOKEN_ASSIGN && const_eval_is_constant(expression->binary.left) &&
+             const_eval_is_constant(expression->binary.right);
+    case THIR_CALL:
+      if (!expression->call.function->function.is_const) return false;
+      for (u32 i = 0; i < expression->call.arguments.length; ++i) {
+        if (!const_eval_is_constant(expression->call.arguments.nodes[i])) return false;
+      }
+      return true;
+    default:
+      return false;
+  }
+}
+
+void const_eval_print_stats(Const_Evaluator *evaluator) {
+  printf("compile time evaluation: %zu evaluations, %zu calls (%zu memoized), %llu steps in %.3f ms\n",
+         evaluator->evaluations, evaluator->calls, evaluator->memo_hits, evaluator->total_steps,
+         evaluator->time * 1000.0);
+}
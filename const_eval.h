@@ -0,0 +1,73 @@
+#ifndef CONST_EVAL_H
+#define CONST_EVAL_H
+
+#include "core.h"
+#include "thir.h"
+
+// Compile time evaluation of @const functions & variables, by interpreting their typed THIR.
+// Values are integers only, kept as s64 and wrapped to their type after every operation so
+// the result matches what the emitted code would have computed at runtime.
+// @const functions can only call other @const functions and have no side effects, so a call
+// with the same arguments always yields the same result, and is only ever evaluated once.
+
+// interpreted nodes per top level evaluation, a single @const can't hang the compiler.
+#define CONST_EVAL_STEP_BUDGET 10000000
+// bytes of interpreter stack, which bounds both the locals and the call depth.
+#define CONST_EVAL_MEMORY_BUDGET (1024 * 1024)
+// what each call frame counts against the memory budget, on top of its locals.
+#define CONST_EVAL_FRAME_COST 256
+
+typedef struct {
+  THIR *declaration; // the THIR_PARAMETER or THIR_VARIABLE_DECLARATION this holds the value of.
+  s64 value;
+} Const_Slot;
+
+typedef struct {
+  u32 function;
+  u32 argument_count;
+  s64 *arguments;
+  s64 result;
+} Const_Memo;
+
+typedef struct Const_Evaluator {
+  Vector stack;      // Vector<Const_Slot>, the locals of every active call.
+  size_t frame;      // index of the current call's first slot.
+  size_t depth;
+  bool returning;
+  s64 return_value;
+  u64 steps;
+  u32 active; // nested const_eval_expression calls.
+
+  Hash_Index memo_index; // hash of (function, arguments) -> index into memo.
+  Vector memo;           // Vector<Const_Memo>
+  Arena arena;           // memoized argument lists.
+
+  // totals for --const-stats.
+  size_t evaluations;
+  size_t calls;
+  size_t memo_hits;
+  u64 total_steps;
+  double time;
+} Const_Evaluator;
+
+struct Query_Engine;
+
+void const_eval_init(Const_Evaluator *evaluator);
+void const_eval_free(Const_Evaluator *evaluator);
+
+// evaluates an integer expression. anything that can't be computed at compile time is an error.
+s64 const_eval_expression(struct Query_Engine *engine, THIR *expression);
+
+// literals, @const variables, and anything else const_eval_expression can compute without locals.
+bool const_eval_is_constant(THIR *expression);
+
+// the width of an integer type, 0 for anything else.
+u32 const_eval_integer_bits(size_t type);
+
+// computes `left operator right` in `type`, exactly as the emitted code would. returns why it can't,
+// for non integers & for operations that trap or are undefined at runtime, and leaves *result alone.
+const char *const_eval_binary(Token_Type operator, size_t type, s64 left, s64 right, s64 *result);
+
+void const_eval_print_stats(Const_Evaluator *evaluator);
+
+#endif
@@ -11,9 +11,12 @@ typedef signed int s32;
 typedef signed short s16;
 typedef signed char s8;
 
+#include <stdalign.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 static void panic(const char *message) {
   fprintf(stderr, "%s\n", message);
@@ -48,12 +51,113 @@ static bool Strings_compare(String a, String b) {
   return strncmp(a.data, b.data, longest) == 0;
 }
 
+// FNV-1a
+static inline u64 hash_bytes(const void *data, size_t length) {
+  const u8 *bytes = data;
+  u64 hash = 0xcbf29ce484222325ull;
+  for (size_t i = 0; i < length; ++i) {
+    hash ^= bytes[i];
+    hash *= 0x100000001b3ull;
+  }
+  return hash;
+}
+
+static inline u64 hash_string(String string) {
+  return hash_bytes(string.data, string.length);
+}
+
+// Open addressing multimap from a 64 bit hash to a size_t value.
+// The index doesn't know what the values mean, so lookups walk every value stored under a hash
+// with hash_index_next and the caller decides which one (if any) actually matches.
+typedef struct {
+  u64 *hashes;
+  size_t *values; // value + 1, 0 marks an empty slot.
+  size_t capacity;
+  size_t length;
+} Hash_Index;
+
+#define HASH_INDEX_END ((size_t)-1)
+
+static void hash_index_insert(Hash_Index *index, u64 hash, size_t value);
+
+static void hash_index_grow(Hash_Index *index) {
+  Hash_Index old = *index;
+  index->capacity = old.capacity ? old.capacity * 2 : 64;
+  index->length = 0;
+  index->hashes = malloc(index->capacity * sizeof(u64));
+  index->values = calloc(index->capacity, sizeof(size_t));
+  if (!index->hashes || !index->values) {
+    panic("Failed to allocate memory for hash index");
+  }
+  for (size_t i = 0; i < old.capacity; ++i) {
+    if (old.values[i]) {
+      hash_index_insert(index, old.hashes[i], old.values[i] - 1);
+    }
+  }
+  free(old.hashes);
+  free(old.values);
+}
+
+static void hash_index_insert(Hash_Index *index, u64 hash, size_t value) {
+  // keep the load factor under 3/4 so probe sequences stay short.
+  if ((index->length + 1) * 4 > index->capacity * 3) {
+    hash_index_grow(index);
+  }
+  size_t mask = index->capacity - 1;
+  size_t slot = hash & mask;
+  while (index->values[slot]) {
+    slot = (slot + 1) & mask;
+  }
+  index->hashes[slot] = hash;
+  index->values[slot] = value + 1;
+  index->length++;
+}
+
+// returns the next value stored under `hash`, or HASH_INDEX_END. `cursor` must start at 0.
+static size_t hash_index_next(Hash_Index *index, u64 hash, size_t *cursor) {
+  if (!index->capacity) {
+    return HASH_INDEX_END;
+  }
+  size_t mask = index->capacity - 1;
+  while (true) {
+    size_t slot = (hash + *cursor) & mask;
+    if (!index->values[slot]) {
+      return HASH_INDEX_END;
+    }
+    (*cursor)++;
+    if (index->hashes[slot] == hash) {
+      return index->values[slot] - 1;
+    }
+  }
+}
+
+// empties the index, keeping its capacity for reuse.
+static void hash_index_clear(Hash_Index *index) {
+  if (index->capacity) {
+    memset(index->values, 0, index->capacity * sizeof(size_t));
+  }
+  index->length = 0;
+}
+
+static void hash_index_free(Hash_Index *index) {
+  free(index->hashes);
+  free(index->values);
+  *index = (Hash_Index){0};
+}
+
 #define PRINT_COLOR "\033[1;33m"
 #define RESET_COLOR "\033[0m"
 #define RUN_COLOR "\033[1;32m"
 #define TIME_COLOR "\033[1;34m"
 
-#define TIME_DIFF(start, end) ((double)(end - start) / CLOCKS_PER_SEC)
+#define TIME_DIFF(start, end) (end - start)
+
+// wall clock seconds, clock() only counts cpu time and would add up every worker thread.
+static inline double time_now() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (double)now.tv_sec + (double)now.tv_nsec * 1e-9;
+}
 
 #define PRINT_TIME(label, time_sec)                                            \
   do {                                                                         \
@@ -73,8 +177,8 @@ static bool Strings_compare(String a, String b) {
 
 #define TIME_REGION(label, code)                                               \
   do {                                                                         \
-    clock_t start = clock();                                                   \
-    code clock_t end = clock();                                                \
+    double start = time_now();                                                 \
+    code double end = time_now();                                              \
     double time_sec = TIME_DIFF(start, end);                                   \
     PRINT_TIME(label, time_sec);                                               \
   } while (0)
@@ -148,47 +252,170 @@ static void *vector_get(Vector *vector, size_t index) {
   return ((char *)vector->data) + (index * vector->element_size);
 }
 
+// -O0 through -Oz, -r is -O3. O0 still runs sroa & mem2reg, see DEBUG_MEM2REG.
 typedef enum {
-  CM_DEBUG,
-  CM_RELEASE,
-} Compilation_Mode; 
+  OPT_O0,
+  OPT_O1,
+  OPT_O2,
+  OPT_O3,
+  OPT_OS,
+  OPT_OZ,
+} Opt_Level;
 
-extern Compilation_Mode COMPILATION_MODE;
+extern Opt_Level OPT_LEVEL;
 
+// --passes=, the pipeline every partition is optimized with instead of the one OPT_LEVEL picks.
+extern const char *PASSES;
+
+// -march= & -mcpu=, the architecture in the target triple & the CPU to generate code for. nullptr means the host's.
+extern const char *TARGET_ARCH;
+extern const char *TARGET_CPU;
+
+// what the backend writes to generated/, set with --emit=. an object also gets linked into generated/output & run.
+// --run writes nothing, and JIT compiles the program & calls its entry point in-process instead.
+typedef enum {
+  EMIT_OBJECT,
+  EMIT_LLVM_IR,
+  EMIT_BITCODE,
+  EMIT_JIT,
+} Emit_Kind;
+
+extern Emit_Kind EMIT_KIND;
+
+// --lto: partitions only get the pre-link pipeline, then are merged into one module that the LTO pipeline
+// optimizes as a whole, with everything but the entry point & exports internalized. -O3 unless given a level.
+extern bool LTO;
+
+// debug builds still run sroa & mem2reg, which promote locals to registers for next to nothing. --no-mem2reg turns it off.
+extern bool DEBUG_MEM2REG;
+
+
+// Chunked bump allocator. Allocation bumps an offset in the tail chunk, and when that runs out
+// a new chunk is linked in, each one twice the size of the last. Nothing is freed individually,
+// arena_rewind drops everything allocated since a mark (keeping the chunks around for reuse),
+// and arena_free releases the lot.
+typedef struct Arena_Chunk {
+  struct Arena_Chunk *next;
+  size_t capacity;
+  size_t used;
+  alignas(max_align_t) u8 data[];
+} Arena_Chunk;
 
 typedef struct Arena {
-  void* data;
-  size_t length;
-  struct Arena *next;
+  Arena_Chunk *head;
+  Arena_Chunk *tail;
+  // capacity of the next chunk we allocate.
+  size_t chunk_size;
+
+  // statistics.
+  size_t bytes_allocated; // live bytes handed out, including alignment padding.
+  size_t bytes_reserved;  // total capacity of every chunk.
+  size_t chunk_count;
 } Arena;
 
-#define ARENA_ALLOC($arena, $type) ($type*)arena_alloc($arena, sizeof($type))
+typedef struct {
+  Arena_Chunk *chunk;
+  size_t used;
+  size_t bytes_allocated;
+} Arena_Mark;
+
+#define ARENA_DEFAULT_CHUNK_SIZE (64 * 1024)
+
+#define ARENA_ALLOC($arena, $type) ($type*)arena_alloc_aligned($arena, sizeof($type), alignof($type))
+#define ARENA_ALLOC_ARRAY($arena, $type, $count) \
+  ($type*)arena_alloc_aligned($arena, sizeof($type) * ($count), alignof($type))
 
 static inline void arena_init(Arena *arena) {
-  arena->data = malloc(1024 * 512);
+  *arena = (Arena){.chunk_size = ARENA_DEFAULT_CHUNK_SIZE};
 }
 
-static inline void *arena_alloc(Arena *arena, size_t size) {
-  if (arena->length < 1024) {
-    void *data = &arena->data[arena->length];
-    arena->length+=size;
-    return data;
-  } else {
-    if (arena->next == NULL) {
-      arena->next = (Arena *)malloc(sizeof(Arena));
-      *arena->next = (Arena){0};
-      arena_init(arena->next);
+static Arena_Chunk *arena_new_chunk(Arena *arena, size_t minimum) {
+  size_t capacity = arena->chunk_size ? arena->chunk_size : ARENA_DEFAULT_CHUNK_SIZE;
+  while (capacity < minimum) {
+    capacity *= 2;
+  }
+  arena->chunk_size = capacity * 2;
+
+  Arena_Chunk *chunk = malloc(sizeof(Arena_Chunk) + capacity);
+  if (!chunk) {
+    panic("Failed to allocate memory for arena");
+  }
+  chunk->next = nullptr;
+  chunk->capacity = capacity;
+  chunk->used = 0;
+  arena->bytes_reserved += capacity;
+  arena->chunk_count++;
+  return chunk;
+}
+
+// `alignment` must be a power of two, no bigger than alignof(max_align_t).
+static inline void *arena_alloc_aligned(Arena *arena, size_t size, size_t alignment) {
+  Arena_Chunk *chunk = arena->tail;
+  if (chunk) {
+    size_t offset = (chunk->used + alignment - 1) & ~(alignment - 1);
+    if (offset + size <= chunk->capacity) {
+      arena->bytes_allocated += offset + size - chunk->used;
+      chunk->used = offset + size;
+      return chunk->data + offset;
+    }
+  }
+
+  // reuse chunks left over from a rewind before allocating new ones.
+  Arena_Chunk *next = chunk ? chunk->next : arena->head;
+  if (!next || next->capacity < size) {
+    Arena_Chunk *fresh = arena_new_chunk(arena, size);
+    fresh->next = next;
+    if (chunk) {
+      chunk->next = fresh;
+    } else {
+      arena->head = fresh;
     }
-    return arena_alloc(arena->next, size);
+    next = fresh;
+  }
+  next->used = size;
+  arena->tail = next;
+  arena->bytes_allocated += size;
+  return next->data;
+}
+
+static inline void *arena_alloc(Arena *arena, size_t size) {
+  return arena_alloc_aligned(arena, size, alignof(max_align_t));
+}
+
+static inline Arena_Mark arena_mark(Arena *arena) {
+  return (Arena_Mark){
+      .chunk = arena->tail,
+      .used = arena->tail ? arena->tail->used : 0,
+      .bytes_allocated = arena->bytes_allocated,
+  };
+}
+
+// frees everything allocated since `mark` was taken.
+static inline void arena_rewind(Arena *arena, Arena_Mark mark) {
+  Arena_Chunk *chunk = mark.chunk ? mark.chunk->next : arena->head;
+  for (; chunk; chunk = chunk->next) {
+    chunk->used = 0;
+  }
+  if (mark.chunk) {
+    mark.chunk->used = mark.used;
   }
+  arena->tail = mark.chunk;
+  arena->bytes_allocated = mark.bytes_allocated;
 }
 
 static void arena_free(Arena *arena) {
-  while (arena != NULL) {
-    Arena *next = arena->next;
-    free(arena);
-    arena = next;
+  Arena_Chunk *chunk = arena->head;
+  while (chunk != NULL) {
+    Arena_Chunk *next = chunk->next;
+    free(chunk);
+    chunk = next;
   }
+  arena_init(arena);
+}
+
+static void arena_print_stats(const char *label, Arena *arena) {
+  printf("%s: %zu bytes allocated, %zu bytes reserved in %zu chunks\n", label, arena->bytes_allocated,
+         arena->bytes_reserved, arena->chunk_count);
 }
 
 #endif
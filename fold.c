@@ -0,0 +1,99 @@
+#include "fold.h"
+#include "const_eval.h"
+#include "core.h"
+#include "thir.h"
+
+static bool is_number(THIR *node, s64 value) {
+  return node->kind == THIR_NUMBER && node->number == value;
+}
+
+// the operand `node` reduces to, when the other one is the operator's identity.
+static THIR *fold_identity(THIR *node) {
+  THIR *left = node->binary.left, *right = node->binary.right;
+  switch (node->binary.operator) {
+    case TOKEN_ADD:
+    case TOKEN_OR:
+    case TOKEN_XOR:
+      if (is_number(right, 0)) return left;
+      if (is_number(left, 0)) return right;
+      break;
+    case TOKEN_MUL:
+      if (is_number(right, 1)) return left;
+      if (is_number(left, 1)) return right;
+      break;
+    case TOKEN_SUB:
+    case TOKEN_SHL:
+    case TOKEN_SHR:
+      if (is_number(right, 0)) return left;
+      break;
+    case TOKEN_DIV:
+      if (is_number(right, 1)) return left;
+      break;
+    default:
+      break;
+  }
+  return nullptr;
+}
+
+static THIR *fold_node(THIR *node, size_t *eliminated) {
+  if (!node) return nullptr;
+
+  switch (node->kind) {
+    case THIR_PROGRAM:
+    case THIR_BLOCK:
+      for (u32 i = 0; i < node->statements.length; ++i) {
+        node->statements.nodes[i] = fold_node(node->statements.nodes[i], eliminated);
+      }
+      break;
+    case THIR_FUNCTION:
+      node->function.block = fold_node(node->function.block, eliminated);
+      break;
+    case THIR_VARIABLE_DECLARATION:
+      node->variable.value = fold_node(node->variable.value, eliminated);
+      break;
+    case THIR_RETURN:
+      node->return_expression = fold_node(node->return_expression, eliminated);
+      break;
+    case THIR_CALL:
+      for (u32 i = 0; i < node->call.arguments.length; ++i) {
+        node->call.arguments.nodes[i] = fold_node(node->call.arguments.nodes[i], eliminated);
+      }
+      break;
+    case THIR_MEMBER_ACCESS:
+      node->member_access.base = fold_node(node->member_access.base, eliminated);
+      break;
+    case THIR_BINARY_EXPRESSION: {
+      node->binary.right = fold_node(node->binary.right, eliminated);
+      if (node->binary.operator == TOKEN_ASSIGN) {
+        break;
+      }
+      node->binary.left = fold_node(node->binary.left, eliminated);
+      THIR *left = node->binary.left, *right = node->binary.right;
+
+      s64 value;
+      if (left->kind == THIR_NUMBER && right->kind == THIR_NUMBER &&
+          !const_eval_binary(node->binary.operator, node->type, left->number, right->number, &value)) {
+        // reuse the node, it's already in the right place with the right type & location.
+        node->kind = THIR_NUMBER;
+        node->number = value;
+        *eliminated += 2;
+        return node;
+      }
+
+      THIR *operand = fold_identity(node);
+      if (operand && operand->type == node->type) {
+        *eliminated += 2;
+        return operand;
+      }
+    } break;
+    default:
+      break;
+  }
+  return node;
+}
+
+size_t fold_thir(THIR *program) {
+  size_t eliminated = 0;
+  fold_node(program, &eliminated);
+  return eliminated;
+}
@@ -0,0 +1,11 @@
+#ifndef FOLD_H
+#define FOLD_H
+
+#include "thir.h"
+
+// Folds arithmetic & comparisons on number literals, and drops identity operations (x + 0, x * 1, x << 0 ...)
+// across every function body, in place. Anything that would trap or be undefined at runtime is left for
+// the program to hit. Returns how many nodes were eliminated.
+size_t fold_thir(THIR *program);
+
+#endif
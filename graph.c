@@ -1,117 +1,309 @@
 #include "graph.h"
 #include "core.h"
+#include "parallel.h"
 #include "parser.h"
+#include "thir.h"
 
-void graph_builder_variable_declaration(AST *node, DepNodeRegistry *registry, DepNode *parent) {
-  Symbol *symbol = find_symbol(node->parent, node->variable.type);
-  // Create a dependency if the type is user-defined.
-  if (symbol && symbol->node) {
-    add_dep_to_dep_node(parent, create_dep_node(symbol->node, registry));
-  }
-
-  // create a dependency if it's a call, binary, or member access.
-  if (node->variable.value) {
-    AST *value = node->variable.value;
-    switch (value->kind) {
-      case AST_NODE_FUNCTION_CALL:
-        return graph_builder_function_call(value, registry, parent);
-      case AST_NODE_BINARY_EXPRESSION:
-        return graph_builder_binary_expression(value, registry, parent);
-      default:
+// only top level functions & types are nodes in the graph, locals and nested declarations are part of
+// whichever declaration they're in.
+static bool is_graph_declaration(AST *node) {
+  return (node->kind == AST_NODE_FUNCTION_DECLARATION || node->kind == AST_NODE_TYPE_DECLARATION) && node->parent &&
+         node->parent->kind == AST_NODE_PROGRAM;
+}
+
+static void graph_builder_reference(AST *scope, String name, AST *declaration, Vector *edges) {
+  Symbol *symbol = find_symbol(scope, name);
+  if (!symbol || !symbol->node || symbol->node == declaration || !is_graph_declaration(symbol->node)) {
+    return;
+  }
+  // each dependency is recorded once per declaration.
+  ForEach(AST *, edge, (*edges), {
+    if (edge == symbol->node) return;
+  });
+  vector_push(edges, &symbol->node);
+}
+
+// generic type names depend on the generic & on each of their arguments.
+static void graph_builder_type_reference(AST *scope, String name, AST *declaration, Vector *edges) {
+  String base;
+  Vector arguments;
+  vector_init(&arguments, sizeof(String));
+  type_name_split(name, &base, &arguments);
+  graph_builder_reference(scope, base, declaration, edges);
+  ForEach(String, argument, arguments, { graph_builder_type_reference(scope, argument, declaration, edges); });
+  vector_free(&arguments);
+}
+
+void graph_builder_declaration(AST *declaration, Vector *edges) {
+  // explicit stack, deeply nested expressions shouldn't be able to blow the native one.
+  Vector stack;
+  vector_init(&stack, sizeof(AST *));
+  vector_push(&stack, &declaration);
+
+  while (stack.length) {
+    AST *node = V_BACK(AST *, stack);
+    stack.length--;
+
+    switch (node->kind) {
+      case AST_NODE_FUNCTION_DECLARATION: {
+        ForEachPtr(AST_Parameter, parameter, node->function.parameters, {
+          if (!parameter->is_vararg) {
+            graph_builder_type_reference(node->parent, parameter->type, declaration, edges);
+          }
+        });
+        graph_builder_type_reference(node->parent, node->function.return_type, declaration, edges);
+        if (!node->function.is_extern) {
+          vector_push(&stack, &node->function.block);
+        }
+      } break;
+      case AST_NODE_TYPE_DECLARATION: {
+        ForEachPtr(AST_Type_Member, member, node->declaration.members,
+                   { graph_builder_type_reference(node->parent, member->type, declaration, edges); });
+      } break;
+      case AST_NODE_BLOCK: {
+        // pushed in reverse so statements get discovered in source order.
+        for (size_t i = node->statements.length; i > 0; --i) {
+          vector_push(&stack, &node->statements.data[i - 1]);
+        }
+      } break;
+      case AST_NODE_VARIABLE_DECLARATION: {
+        graph_builder_type_reference(node->parent, node->variable.type, declaration, edges);
+        if (node->variable.value) {
+          vector_push(&stack, &node->variable.value);
+        }
+      } break;
+      case AST_NODE_FUNCTION_CALL: {
+        graph_builder_reference(node->parent, node->call.name, declaration, edges);
+        for (size_t i = node->call.arguments.length; i > 0; --i) {
+          vector_push(&stack, vector_get(&node->call.arguments, i - 1));
+        }
+      } break;
+      case AST_NODE_BINARY_EXPRESSION: {
+        vector_push(&stack, &node->binary.right);
+        vector_push(&stack, &node->binary.left);
+      } break;
+      case AST_NODE_DOT_EXPRESSION: {
+        vector_push(&stack, &node->dot.left);
+      } break;
+      case AST_NODE_RETURN: {
+        if (node->return_expression) {
+          vector_push(&stack, &node->return_expression);
+        }
+      } break;
+      case AST_NODE_IDENTIFIER: {
+        graph_builder_reference(node->parent, node->identifier, declaration, edges);
+      } break;
+      case AST_NODE_NUMBER:
+      case AST_NODE_STRING:
+      case AST_NODE_PROGRAM:
         break;
     }
   }
+
+  vector_free(&stack);
 }
 
-void graph_builder_function_call(AST *node, DepNodeRegistry *registry, DepNode *parent) {
-  Symbol *symbol = find_symbol(node->parent, node->call.name);
-  add_dep_to_dep_node(parent, create_dep_node(symbol->node, registry));
+typedef struct {
+  AST *root;
+  // one Vector<AST *> per top level statement.
+  Vector *edges;
+} DepEdgeDiscovery;
+
+static void discover_declaration_edges(void *user, size_t index) {
+  DepEdgeDiscovery *discovery = user;
+  AST *statement = discovery->root->statements.data[index];
+  Vector *edges = &discovery->edges[index];
+  if (is_graph_declaration(statement)) {
+    graph_builder_declaration(statement, edges);
+  }
 }
 
-void graph_builder_binary_expression(AST *node, DepNodeRegistry *registry, DepNode *parent) {
-  add_dep_to_dep_node(parent, create_dep_node(node->binary.left, registry));
-  add_dep_to_dep_node(parent, create_dep_node(node->binary.right, registry));
+void populate_dep_graph(DepNodeRegistry *registry, DepGraph *graph, AST *root_node) {
+  size_t length = root_node->statements.length;
+  DepEdgeDiscovery discovery = {
+      .root = root_node,
+      .edges = malloc(length * sizeof(Vector)),
+  };
+  for (size_t i = 0; i < length; ++i) {
+    vector_init(&discovery.edges[i], sizeof(AST *));
+  }
+
+  // edge discovery is all symbol lookups over the (by now immutable) AST, so each declaration gets walked on a worker.
+  parallel_for(length, &discovery, discover_declaration_edges);
+
+  // then merge in statement order, so the registry & graph come out the same regardless of scheduling.
+  for (size_t i = 0; i < length; ++i) {
+    AST *statement = root_node->statements.data[i];
+    Vector *edges = &discovery.edges[i];
+    if (is_graph_declaration(statement)) {
+      DepNode *dep_node = create_dep_node(statement, registry);
+      add_node_to_dep_graph(graph, dep_node);
+      ForEach(AST *, dependency, (*edges), { add_dep_to_dep_node(dep_node, create_dep_node(dependency, registry)); });
+    }
+    vector_free(edges);
+  }
+
+  free(discovery.edges);
 }
 
-void graph_builder_return_statement(AST *node, DepNodeRegistry *registry, DepNode *parent) {
-  if (node->return_expression) {
-    add_dep_to_dep_node(parent, create_dep_node(node->return_expression, registry));
+String dep_node_name(DepNode *node) {
+  AST *ast = node->ast_node;
+  switch (ast->kind) {
+    case AST_NODE_FUNCTION_DECLARATION:
+      return ast->function.name;
+    case AST_NODE_TYPE_DECLARATION:
+      return ast->declaration.name;
+    case AST_NODE_VARIABLE_DECLARATION:
+      return ast->variable.name;
+    case AST_NODE_IDENTIFIER:
+      return ast->identifier;
+    case AST_NODE_FUNCTION_CALL:
+      return ast->call.name;
+    default:
+      return (String){.data = "<expression>", .length = 12};
   }
 }
 
-void graph_builder_block(AST *node, DepNodeRegistry *registry, DepNode *parent) {
-  for (int i = 0; i < node->statements.length; ++i) {
-    AST *statement = node->statements.data[i];
-    switch (statement->kind) {
-      case AST_NODE_VARIABLE_DECLARATION:
-        return graph_builder_variable_declaration(statement, registry, parent);
-      case AST_NODE_FUNCTION_CALL:
-        return graph_builder_function_call(statement, registry, parent);
-      case AST_NODE_BLOCK:
-        return graph_builder_block(statement, registry, parent);
-      case AST_NODE_BINARY_EXPRESSION:
-        return graph_builder_binary_expression(statement, registry, parent);
-      case AST_NODE_RETURN:
-        return graph_builder_return_statement(statement, registry, parent);
-        break;
-      default:
-        break;
+const char *dep_node_kind(DepNode *node) {
+  return Node_Kind_String[node->ast_node->kind];
+}
+
+static void print_node(DepNode *node, bool *visited, int indentation) {
+  for (int i = 0; i < indentation; ++i) {
+    printf("  ");
+  }
+  String name = dep_node_name(node);
+  if (visited[node->id]) {
+    // shared subtrees only get printed once, otherwise diamonds blow up exponentially.
+    printf("%.*s (see above)\n", name.length, name.data);
+    return;
+  }
+  visited[node->id] = true;
+  printf("%.*s :: %s, num_deps: %zu", name.length, name.data, dep_node_kind(node), node->length);
+  if (node->error) {
+    printf(", error: %s", node->error);
+  }
+  printf("\n");
+  for (int i = 0; i < node->length; ++i) {
+    print_node(node->dependencies[i], visited, indentation + 1);
+  }
+}
+
+void print_graph(DepNodeRegistry *registry, DepGraph *graph) {
+  bool *visited = calloc(registry->length, sizeof(bool));
+  for (int i = 0; i < graph->length; ++i) {
+    DepNode *node = graph->nodes[i];
+    if (!visited[node->id]) {
+      print_node(node, visited, 0);
     }
   }
+  free(visited);
 }
 
-void graph_builder_function_declaration(AST *node, DepNodeRegistry *registry, DepGraph *graph) {
-  DepNode *dep_node = create_dep_node(node, registry);
-  add_node_to_dep_graph(graph, dep_node);
+void write_dep_graph_dot(DepNodeRegistry *registry, FILE *file) {
+  fprintf(file, "digraph dependencies {\n");
+  fprintf(file, "  node [shape=box];\n");
+  for (size_t i = 0; i < registry->length; ++i) {
+    DepNode *node = registry->nodes[i];
+    String name = dep_node_name(node);
+    fprintf(file, "  n%zu [label=\"%.*s\\n%s\\ntype: %.3f ms, emit: %.3f ms\"];\n", node->id, name.length, name.data,
+            dep_node_kind(node), node->typing_time * 1e3, node->emission_time * 1e3);
+  }
+  for (size_t i = 0; i < registry->length; ++i) {
+    DepNode *node = registry->nodes[i];
+    for (size_t j = 0; j < node->length; ++j) {
+      fprintf(file, "  n%zu -> n%zu;\n", node->id, node->dependencies[j]->id);
+    }
+  }
+  fprintf(file, "}\n");
+}
 
-  for (int i = 0; i < node->function.parameters.length; ++i) {
-    AST_Parameter *parameter = ((AST_Parameter *)vector_get(&node->function.parameters, i));
-    if (parameter->is_vararg) {
-      continue;
+void write_dep_graph_json(DepNodeRegistry *registry, FILE *file) {
+  fprintf(file, "{\n  \"nodes\": [\n");
+  for (size_t i = 0; i < registry->length; ++i) {
+    DepNode *node = registry->nodes[i];
+    String name = dep_node_name(node);
+    fprintf(file, "    {\"id\": %zu, \"name\": \"%.*s\", \"kind\": \"%s\", \"typing_time\": %.9f, \"emission_time\": %.9f, \"dependencies\": [",
+            node->id, name.length, name.data, dep_node_kind(node), node->typing_time, node->emission_time);
+    for (size_t j = 0; j < node->length; ++j) {
+      fprintf(file, j ? ", %zu" : "%zu", node->dependencies[j]->id);
     }
+    fprintf(file, "]}%s\n", i + 1 < registry->length ? "," : "");
+  }
+  fprintf(file, "  ]\n}\n");
+}
 
-    Symbol *symbol = find_symbol(node->parent, parameter->type);
+static double dep_node_cost(DepNode *node) {
+  return node->typing_time + node->emission_time;
+}
 
-    // for shit like String, i32 etc,
-    // we won't get a node. 
-    // also these don't need to be recorded since they're builtin.
-    if (symbol && symbol->node) {
-      add_dep_to_dep_node(dep_node, create_dep_node(symbol->node, registry));
+static double longest_chain(DepNode *node, double *chain, DepNode **next, bool *visiting) {
+  if (chain[node->id] >= 0) {
+    return chain[node->id];
+  }
+  if (visiting[node->id]) {
+    // cycles get reported by the typer, don't recurse forever here.
+    return 0;
+  }
+  visiting[node->id] = true;
+  double longest = 0;
+  for (size_t i = 0; i < node->length; ++i) {
+    double length = longest_chain(node->dependencies[i], chain, next, visiting);
+    if (length > longest || !next[node->id]) {
+      longest = length;
+      next[node->id] = node->dependencies[i];
     }
   }
+  visiting[node->id] = false;
+  chain[node->id] = dep_node_cost(node) + longest;
+  return chain[node->id];
+}
 
-  if (node->function.is_extern) {
-    return;
+void report_critical_path(DepNodeRegistry *registry) {
+  size_t n = registry->length;
+  double *chain = malloc(n * sizeof(double));
+  DepNode **next = calloc(n, sizeof(DepNode *));
+  bool *visiting = calloc(n, sizeof(bool));
+  for (size_t i = 0; i < n; ++i) {
+    chain[i] = -1;
   }
 
-  graph_builder_block(node->function.block, registry, dep_node);
-}
-
-void graph_builder_type_declaration(AST *node, DepNodeRegistry *registry, DepGraph *graph) {
-  DepNode *dep_node = create_dep_node(node, registry);
+  double total = 0;
+  DepNode *head = nullptr;
+  for (size_t i = 0; i < n; ++i) {
+    DepNode *node = registry->nodes[i];
+    total += dep_node_cost(node);
+    longest_chain(node, chain, next, visiting);
+    if (!head || chain[node->id] > chain[head->id]) {
+      head = node;
+    }
+  }
 
-  ForEachPtr(AST_Type_Member, member, node->declaration.members, {
-    Symbol *symbol = find_symbol(node->parent, member->type);
-    if (symbol && symbol->node) {
-      add_dep_to_dep_node(dep_node, create_dep_node(symbol->node, registry));
+  printf("critical path:\n");
+  if (head) {
+    for (DepNode *node = head; node; node = next[node->id]) {
+      String name = dep_node_name(node);
+      printf("  %.*s :: %s, %.3f ms\n", name.length, name.data, dep_node_kind(node), dep_node_cost(node) * 1e3);
     }
-  });
+    double critical = chain[head->id];
+    printf("total work: %.3f ms, critical path: %.3f ms, max parallel speedup: %.2fx\n", total * 1e3, critical * 1e3,
+           critical > 0 ? total / critical : 1.0);
+  }
 
-  add_node_to_dep_graph(graph, dep_node);
+  free(chain);
+  free(next);
+  free(visiting);
 }
 
-void populate_dep_graph(DepNodeRegistry *registry, DepGraph *graph, AST *root_node) {
-  for (int i = 0; i < root_node->statements.length; ++i) {
-    AST *statement = root_node->statements.data[i];
-    switch (statement->kind) {
-      case AST_NODE_FUNCTION_DECLARATION:
-        graph_builder_function_declaration(statement, registry, graph);
-        break;
-      case AST_NODE_TYPE_DECLARATION:
-        graph_builder_type_declaration(statement, registry, graph);
-        break;
-      default:
-        break;
-    }
+void collect_emission_times(DepNodeRegistry *registry, Vector *functions) {
+  for (size_t i = 0; i < registry->length; ++i) {
+    registry->nodes[i]->emission_time = 0;
   }
+  // instances count towards their generic, like their typing time does.
+  ForEach(THIR *, function, (*functions), {
+    DepNode *node = function->function.declaration ? function->function.declaration->dep_node : nullptr;
+    if (node) {
+      node->emission_time += function->function.emission_time;
+    }
+  });
 }
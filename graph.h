@@ -12,13 +12,23 @@ typedef enum {
   ERRORED,
 } DepState;
 
+typedef struct THIR THIR;
+
 typedef struct DepNode {
   AST *ast_node;
+  THIR *thir;
 
   struct DepNode **dependencies;
   size_t length;
   size_t capacity;
 
+  // index into the registry, used for visited sets & per node tables.
+  size_t id;
+
+  // measured cost, in seconds, of typing this node and emitting its LLVM IR.
+  double typing_time;
+  double emission_time;
+
   char *error;
   DepState state;
 } DepNode;
@@ -33,28 +43,28 @@ typedef struct DepNodeRegistry {
   DepNode **nodes;
   size_t length;
   size_t capacity;
+  // backing storage for the DepNodes themselves.
+  Arena arena;
 } DepNodeRegistry;
 
 static inline void add_node_to_dep_registry(DepNodeRegistry *registry, DepNode *node);
 
 static inline DepNode *create_dep_node(AST *node, DepNodeRegistry *registry) {
   // caching/deduplication
-  for (int i = 0; i < registry->length; ++i) {
-    DepNode *dep_node = registry->nodes[i];
-    if (dep_node->ast_node == node) {
-      return dep_node;
-    }
+  if (node->dep_node) {
+    return node->dep_node;
   }
-  DepNode *dep_node = malloc(sizeof(DepNode));
+  DepNode *dep_node = ARENA_ALLOC(&registry->arena, DepNode);
   memset(dep_node, 0, sizeof(DepNode));
   dep_node->ast_node = node;
+  node->dep_node = dep_node;
   add_node_to_dep_registry(registry, dep_node);
   return dep_node;
 }
 
 static inline void free_dep_node(DepNode *node) {
-  for (int i = 0; i < node->length; ++i) {
-    free_dep_node(node->dependencies[i]);
+  if (node->dependencies) {
+    free(node->dependencies);
   }
   if (node->error) {
     free(node->error);
@@ -68,17 +78,25 @@ static inline DepGraph *create_dep_graph() {
   return graph;
 }
 
+// the graph only references nodes, they're owned by the registry.
 static inline void free_dep_graph(DepGraph *graph) {
-  for (int i = 0; i < graph->length; ++i) {
-    free_dep_node(graph->nodes[i]);
-  }
-
   graph->length = 0;
   graph->capacity = 0;
 
   if (graph->nodes) free(graph->nodes);
 }
 
+static inline void free_dep_registry(DepNodeRegistry *registry) {
+  for (size_t i = 0; i < registry->length; ++i) {
+    free_dep_node(registry->nodes[i]);
+  }
+  if (registry->nodes) free(registry->nodes);
+  registry->nodes = nullptr;
+  registry->length = 0;
+  registry->capacity = 0;
+  arena_free(&registry->arena);
+}
+
 static inline void add_node_to_dep_graph(DepGraph *graph, DepNode *node) {
   if (graph->nodes == nullptr) {
     graph->capacity = 32;
@@ -104,6 +122,7 @@ static inline void add_node_to_dep_registry(DepNodeRegistry *registry, DepNode *
     registry->nodes = realloc(registry->nodes, registry->capacity * sizeof(DepNode *));
   }
 
+  node->id = registry->length;
   registry->nodes[registry->length++] = node;
 }
 
@@ -130,34 +149,31 @@ static inline void add_dep_to_dep_node(DepNode *node, DepNode *dep) {
   node->dependencies[node->length++] = dep;
 }
 
-void graph_builder_function_declaration(AST *node, DepNodeRegistry *registry, DepGraph *graph);
-void graph_builder_type_declaration(AST *node, DepNodeRegistry *registry, DepGraph *graph);
-void graph_builder_variable_declaration(AST *node, DepNodeRegistry *registry, DepNode *parent);
-void graph_builder_function_call(AST *node, DepNodeRegistry *registry, DepNode *parent);
-void graph_builder_binary_expression(AST *node, DepNodeRegistry *registry, DepNode *parent);
-void graph_builder_return_statement(AST *node, DepNodeRegistry *registry, DepNode *parent);
-void graph_builder_block(AST *node, DepNodeRegistry *registry, DepNode *parent);
+// Walks a top level declaration and pushes every declaration it references into `edges` (Vector<AST *>), once each.
+// It only discovers edges and never touches the registry or graph, which keeps it safe to run on worker threads,
+// see populate_dep_graph.
+void graph_builder_declaration(AST *declaration, Vector *edges);
 
 void populate_dep_graph(DepNodeRegistry *registry, DepGraph *graph, AST *root_node);
 
-extern int node_printer_indentation;
-static inline void print_node(DepNode *node) {
-  for (int i = 0; i < node_printer_indentation; ++i) {
-    printf("  ");
-  }
-  printf("node: %p, ast_node: %p, num_deps: %zu, error: %s\n", node, node->ast_node, node->length, node->error);
-  node_printer_indentation++;
-  for (int i = 0; i < node->length; ++i) {
-    print_node(node->dependencies[i]);
-  }
-  node_printer_indentation--;
-}
+typedef enum {
+  DEP_GRAPH_FORMAT_NONE,
+  DEP_GRAPH_FORMAT_DOT,
+  DEP_GRAPH_FORMAT_JSON,
+} DepGraphFormat;
 
-static inline void print_graph(DepGraph *graph) {
-  for (int i = 0; i < graph->length; ++i) {
-    DepNode *node = graph->nodes[i];
-    print_node(node);
-  }
-}
+String dep_node_name(DepNode *node);
+const char *dep_node_kind(DepNode *node);
+
+void print_graph(DepNodeRegistry *registry, DepGraph *graph);
+void write_dep_graph_dot(DepNodeRegistry *registry, FILE *file);
+void write_dep_graph_json(DepNodeRegistry *registry, FILE *file);
+
+// Prints the longest chain of dependencies, weighted by typing + emission time.
+// No amount of parallelism can build faster than this chain, so total / critical is the speedup bound.
+void report_critical_path(DepNodeRegistry *registry);
+
+// adds up the emission times the backend recorded on the emitted functions (Vector<THIR *>) onto the graph.
+void collect_emission_times(DepNodeRegistry *registry, Vector *functions);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,151 @@
+#include "inline.h"
+#include "core.h"
+#include "thir.h"
+
+typedef enum : u8 {
+  INLINE_UNDECIDED,
+  INLINE_YES,
+  INLINE_NO,
+} Inline_Decision;
+
+typedef struct {
+  Inline_Decision *decisions; // indexed by function id.
+  Inline_Stats stats;
+} Inliner;
+
+// nodes in `node`, or -1 when it isn't something that can be cloned into a caller.
+static int inline_cost(THIR *node) {
+  switch (node->kind) {
+    case THIR_NUMBER:
+    case THIR_STRING:
+    case THIR_IDENTIFIER:
+      return 1;
+    case THIR_MEMBER_ACCESS: {
+      int base = inline_cost(node->member_access.base);
+      return base < 0 ? -1 : base + 1;
+    }
+    case THIR_BINARY_EXPRESSION: {
+      if (node->binary.operator == TOKEN_ASSIGN) return -1;
+      int left = inline_cost(node->binary.left);
+      int right = inline_cost(node->binary.right);
+      return left < 0 || right < 0 ? -1 : left + right + 1;
+    }
+    default:
+      return -1;
+  }
+}
+
+static THIR *inline_body(THIR *function) {
+  THIR *block = function->function.block;
+  if (!block || block->statements.length != 1) return nullptr;
+  THIR *statement = block->statements.nodes[0];
+  if (statement->kind != THIR_RETURN) return nullptr;
+  return statement->return_expression;
+}
+
+static bool should_inline(Inliner *inliner, THIR *function) {
+  Inline_Decision *decision = &inliner->decisions[function->function.id];
+  if (*decision == INLINE_UNDECIDED) {
+    *decision = INLINE_NO;
+    THIR *expression = inline_body(function);
+    bool is_noinline = function->function.is_noinline || function->function.is_optnone;
+    if (!function->function.is_extern && !is_noinline && expression) {
+      int cost = inline_cost(expression);
+      if (cost >= 0 && (cost <= INLINE_MAX_COST || function->function.is_inline)) {
+        *decision = INLINE_YES;
+      }
+    }
+  }
+  return *decision == INLINE_YES;
+}
+
+// arguments get duplicated or dropped depending on how often the parameter is used,
+// so they can't have side effects. the cost model already rules out calls & assignments.
+static bool is_pure(THIR *node) {
+  return inline_cost(node) >= 0;
+}
+
+// copies `node` for the call site, with `function`'s parameters replaced by the call's arguments.
+// without a call it's a plain copy, the arguments already refer to the caller's own parameters.
+static THIR *inline_clone(Inliner *inliner, THIR *node, THIR *function, THIR *call) {
+  if (call && node->kind == THIR_IDENTIFIER && node->identifier.resolved->kind == THIR_PARAMETER) {
+    u32 slot = node->identifier.resolved->parameter.slot;
+    if (slot < function->function.parameters.length &&
+        function->function.parameters.nodes[slot] == node->identifier.resolved) {
+      return inline_clone(inliner, call->call.arguments.nodes[slot], nullptr, nullptr);
+    }
+  }
+
+  THIR *clone = THIR_ALLOC(node->kind, node->location);
+  *clone = *node;
+  // the callee's own nodes are attributed to the call, the arguments keep where they came from.
+  if (call) clone->location = call->location;
+  inliner->stats.cloned_nodes++;
+
+  switch (node->kind) {
+    case THIR_MEMBER_ACCESS:
+      clone->member_access.base = inline_clone(inliner, node->member_access.base, function, call);
+      break;
+    case THIR_BINARY_EXPRESSION:
+      clone->binary.left = inline_clone(inliner, node->binary.left, function, call);
+      clone->binary.right = inline_clone(inliner, node->binary.right, function, call);
+      break;
+    default:
+      break;
+  }
+  return clone;
+}
+
+static THIR *inline_node(Inliner *inliner, THIR *node) {
+  if (!node) return nullptr;
+
+  switch (node->kind) {
+    case THIR_PROGRAM:
+    case THIR_BLOCK:
+      for (u32 i = 0; i < node->statements.length; ++i) {
+        node->statements.nodes[i] = inline_node(inliner, node->statements.nodes[i]);
+      }
+      break;
+    case THIR_FUNCTION:
+      node->function.block = inline_node(inliner, node->function.block);
+      break;
+    case THIR_VARIABLE_DECLARATION:
+      node->variable.value = inline_node(inliner, node->variable.value);
+      break;
+    case THIR_RETURN:
+      node->return_expression = inline_node(inliner, node->return_expression);
+      break;
+    case THIR_MEMBER_ACCESS:
+      node->member_access.base = inline_node(inliner, node->member_access.base);
+      break;
+    case THIR_BINARY_EXPRESSION:
+      node->binary.left = inline_node(inliner, node->binary.left);
+      node->binary.right = inline_node(inliner, node->binary.right);
+      break;
+    case THIR_CALL: {
+      bool pure_arguments = true;
+      for (u32 i = 0; i < node->call.arguments.length; ++i) {
+        node->call.arguments.nodes[i] = inline_node(inliner, node->call.arguments.nodes[i]);
+        pure_arguments &= is_pure(node->call.arguments.nodes[i]);
+      }
+
+      inliner->stats.call_sites++;
+      THIR *function = node->call.function;
+      if (pure_arguments && should_inline(inliner, function)) {
+        // the typer checked the return against the signature, so the expression has the call's type.
+        inliner->stats.inlined++;
+        return inline_clone(inliner, inline_body(function), function, node);
+      }
+    } break;
+    default:
+      break;
+  }
+  return node;
+}
+
+Inline_Stats inline_thir(THIR *program) {
+  Inliner inliner = {.decisions = calloc(thir_function_count + 1, sizeof(Inline_Decision))};
+  inline_node(&inliner, program);
+  free(inliner.decisions);
+  return inliner.stats;
+}
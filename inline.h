@@ -0,0 +1,21 @@
+#ifndef INLINE_H
+#define INLINE_H
+
+#include "thir.h"
+
+// Functions whose body is a single `return <expression>;` with no calls in it, are small enough and not
+// @noinline or @optnone, get their expression substituted for each call, with the parameters replaced by the arguments.
+// Being leaves, they can't be recursive, and extern functions have no body to inline.
+
+// nodes in the returned expression, above this a function is only inlined when it's marked @inline.
+#define INLINE_MAX_COST 16
+
+typedef struct {
+  size_t call_sites;
+  size_t inlined;
+  size_t cloned_nodes;
+} Inline_Stats;
+
+Inline_Stats inline_thir(THIR *program);
+
+#endif
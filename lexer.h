@@ -2,6 +2,7 @@
 #define LEX_H
 #include "core.h"
 #include <ctype.h>
+#include <stdint.h>
 #include <stdio.h>
 
 typedef enum {
@@ -17,6 +18,7 @@ typedef enum {
   TOKEN_AT,
   TOKEN_DOT,
   TOKEN_COMMA,
+  TOKEN_COLON,
   TOKEN_ASSIGN,
   TOKEN_SEMICOLON,
 
@@ -64,6 +66,7 @@ static const char* Token_Type_Name(Token_Type type) {
     TOKEN_TYPE_NAME_CASE(TOKEN_AT)
     TOKEN_TYPE_NAME_CASE(TOKEN_DOT)
     TOKEN_TYPE_NAME_CASE(TOKEN_COMMA)
+    TOKEN_TYPE_NAME_CASE(TOKEN_COLON)
     TOKEN_TYPE_NAME_CASE(TOKEN_ASSIGN)
     TOKEN_TYPE_NAME_CASE(TOKEN_SEMICOLON)
     TOKEN_TYPE_NAME_CASE(TOKEN_OPEN_PAREN)
@@ -97,12 +100,44 @@ typedef struct Source_Location {
   const char *file;
 } Source_Location;
 
+// the type a numeric literal was written with, as in `255u8`. without one the typer picks it from where the
+// literal is used.
+typedef enum : u8 {
+  NUMBER_SUFFIX_NONE,
+  NUMBER_SUFFIX_I8,
+  NUMBER_SUFFIX_I16,
+  NUMBER_SUFFIX_I32,
+  NUMBER_SUFFIX_I64,
+  NUMBER_SUFFIX_U8,
+  NUMBER_SUFFIX_U16,
+  NUMBER_SUFFIX_U32,
+  NUMBER_SUFFIX_U64,
+} Number_Suffix;
+
+static const char *number_suffix_names[] = {"", "i8", "i16", "i32", "i64", "u8", "u16", "u32", "u64"};
+
 typedef struct {
   Token_Type type;
   String value;
   Source_Location location;
+  // TOKEN_NUMBER only, the literal's value & suffix, so nothing after the lexer parses the text again.
+  u64 number;
+  Number_Suffix suffix;
 } Token;
 
+[[noreturn]]
+static void lexer_panic(Source_Location location, const char *message) {
+  fprintf(stderr, "at: %s:%d:%d\nerror: %s\n", location.file, location.line, location.column, message);
+  exit(1);
+}
+
+static int lexer_digit_value(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
 typedef struct {
   char *content;
   size_t length;
@@ -183,6 +218,7 @@ static Operator operator_map[] = {
     {">>", TOKEN_SHR},        {"==", TOKEN_EQ},         {"!=", TOKEN_NEQ},
     {"!", TOKEN_LOGICAL_NOT}, {"||", TOKEN_LOGICAL_OR}, {"<", TOKEN_LT},
     {">", TOKEN_GT},          {">=", TOKEN_GTE},        {"<=", TOKEN_LTE},
+    {":", TOKEN_COLON},
 };
 
 static bool is_binary_operator(Token_Type operator) {
@@ -334,14 +370,54 @@ static Token get_token(Lexer_State *state) {
       }
       return token;
     } else if (isdigit(c)) {
+      // decimal, 0x hex or 0b binary, with optional `_` separators & a type suffix.
       token.type = TOKEN_NUMBER;
-      char *start = &state->content[state->position - 1];
-      size_t length = 1;
-      while (isdigit(c = lexer_state_eat_char(state))) {
-        length++;
+      size_t start = state->position - 1;
+      u64 base = 10, value = c - '0';
+      size_t digits = 1;
+      char next = lexer_state_peek_char(state);
+      if (c == '0' && (next == 'x' || next == 'X' || next == 'b' || next == 'B')) {
+        lexer_state_eat_char(state);
+        base = next == 'x' || next == 'X' ? 16 : 2;
+        digits = 0;
       }
-      state->position--; // Unread the last character
-      token.value = String_new(start, length);
+      bool overflow = false;
+      while (1) {
+        c = lexer_state_peek_char(state);
+        int digit = lexer_digit_value(c);
+        if (c != '_' && (digit < 0 || digit >= base)) break;
+        lexer_state_eat_char(state);
+        if (c == '_') continue;
+        if (value > (UINT64_MAX - digit) / base) overflow = true;
+        value = value * base + digit;
+        digits++;
+      }
+      if (!digits) {
+        lexer_panic(token.location, "expected digits after the base prefix of a number");
+      }
+      if (overflow) {
+        lexer_panic(token.location, "number doesn't fit in 64 bits");
+      }
+
+      size_t suffix_start = state->position;
+      while (isalnum(lexer_state_peek_char(state)) || lexer_state_peek_char(state) == '_') {
+        lexer_state_eat_char(state);
+      }
+      String suffix = {.data = &state->content[suffix_start], .length = state->position - suffix_start};
+      token.suffix = NUMBER_SUFFIX_NONE;
+      if (suffix.length) {
+        for (int i = NUMBER_SUFFIX_I8; i <= NUMBER_SUFFIX_U64; ++i) {
+          if (suffix.length == strlen(number_suffix_names[i]) &&
+              strncmp(suffix.data, number_suffix_names[i], suffix.length) == 0) {
+            token.suffix = i;
+          }
+        }
+        if (token.suffix == NUMBER_SUFFIX_NONE) {
+          lexer_panic(token.location, "invalid suffix on a number, expected one of i8 i16 i32 i64 u8 u16 u32 u64");
+        }
+      }
+      token.number = value;
+      token.value = String_new(&state->content[start], state->position - start);
       return token;
     } else if (ispunct(c)) {
       char next_char = lexer_state_peek_char(state);
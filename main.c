@@ -1,7 +1,11 @@
 #include "backend.h"
 #include "core.h"
+#include "fold.h"
 #include "graph.h"
+#include "inline.h"
+#include "parallel.h"
 #include "parser.h"
+#include "query.h"
 #include "thir.h"
 #include "type.h"
 #include "typer.h"
@@ -9,11 +13,22 @@
 #include <time.h>
 
 size_t address = 0;
-Vector type_table;
-Compilation_Mode COMPILATION_MODE = CM_DEBUG;
-int node_printer_indentation = 0;
+Type_Table type_table = {.lock = PTHREAD_MUTEX_INITIALIZER};
+Hash_Index type_name_index;
+Hash_Index function_type_index;
+Opt_Level OPT_LEVEL = OPT_O0;
+const char *PASSES = nullptr;
+const char *TARGET_ARCH = nullptr;
+const char *TARGET_CPU = nullptr;
+bool DEBUG_MEM2REG = true;
+Emit_Kind EMIT_KIND = EMIT_OBJECT;
+bool LTO = false;
+size_t THREAD_COUNT = 0;
 
 Arena thir_arena;
+String_Pool string_pool = {.lock = PTHREAD_MUTEX_INITIALIZER};
+thread_local Arena *thir_allocator = &thir_arena;
+Arena symbol_arena;
 
 
 void parse_program(Lexer_State *state, AST_Arena *arena, AST *program) {
@@ -26,16 +41,81 @@ void parse_program(Lexer_State *state, AST_Arena *arena, AST *program) {
 }
 
 int main(int argc, char *argv[]) {
-  if (argc > 1) {
-    if (strncmp(argv[1], "-r", 2) == 0) {
-      COMPILATION_MODE = CM_RELEASE;
+  DepGraphFormat dep_graph_format = DEP_GRAPH_FORMAT_NONE;
+  bool report_critical = false;
+  bool arena_stats = false;
+  bool demand_typing = false;
+  bool const_stats = false;
+  bool check_invalidation = false;
+
+  static const char *opt_level_flags[] = {"-O0", "-O1", "-O2", "-O3", "-Os", "-Oz"};
+  bool opt_level_set = false;
+
+  for (int i = 1; i < argc; ++i) {
+    int opt_level = -1;
+    for (int level = OPT_O0; level <= OPT_OZ; ++level) {
+      if (strcmp(argv[i], opt_level_flags[level]) == 0) opt_level = level;
+    }
+
+    if (opt_level >= 0) {
+      OPT_LEVEL = opt_level;
+      opt_level_set = true;
+    } else if (strncmp(argv[i], "-r", 2) == 0) {
+      OPT_LEVEL = OPT_O3;
+      opt_level_set = true;
+    } else if (strncmp(argv[i], "--passes=", 9) == 0) {
+      PASSES = argv[i] + 9;
+    } else if (strncmp(argv[i], "-march=", 7) == 0) {
+      TARGET_ARCH = argv[i] + 7;
+    } else if (strncmp(argv[i], "-mcpu=", 6) == 0) {
+      TARGET_CPU = argv[i] + 6;
+    } else if (strcmp(argv[i], "--emit-dep-graph=dot") == 0) {
+      dep_graph_format = DEP_GRAPH_FORMAT_DOT;
+    } else if (strcmp(argv[i], "--emit-dep-graph=json") == 0) {
+      dep_graph_format = DEP_GRAPH_FORMAT_JSON;
+    } else if (strncmp(argv[i], "-j", 2) == 0) {
+      THREAD_COUNT = strtoull(argv[i] + 2, nullptr, 10);
+    } else if (strcmp(argv[i], "--emit=obj") == 0) {
+      EMIT_KIND = EMIT_OBJECT;
+    } else if (strcmp(argv[i], "--emit=ll") == 0) {
+      EMIT_KIND = EMIT_LLVM_IR;
+    } else if (strcmp(argv[i], "--emit=bc") == 0) {
+      EMIT_KIND = EMIT_BITCODE;
+    } else if (strcmp(argv[i], "--lto") == 0) {
+      LTO = true;
+    } else if (strcmp(argv[i], "--run") == 0) {
+      EMIT_KIND = EMIT_JIT;
+    } else if (strcmp(argv[i], "--no-mem2reg") == 0) {
+      DEBUG_MEM2REG = false;
+    } else if (strcmp(argv[i], "--demand-typing") == 0) {
+      demand_typing = true;
+    } else if (strcmp(argv[i], "--arena-stats") == 0) {
+      arena_stats = true;
+    } else if (strcmp(argv[i], "--const-stats") == 0) {
+      const_stats = true;
+    } else if (strcmp(argv[i], "--check-invalidation") == 0) {
+      check_invalidation = true;
+    } else if (strcmp(argv[i], "--critical-path") == 0) {
+      report_critical = true;
+    } else {
+      fprintf(stderr, "unknown argument '%s'\n", argv[i]);
+      return 1;
     }
   }
 
+  if (LTO && !opt_level_set) {
+    OPT_LEVEL = OPT_O3;
+  }
+  if (TARGET_ARCH && EMIT_KIND == EMIT_JIT) {
+    fprintf(stderr, "--run can only generate code for the host, not '-march=%s'\n", TARGET_ARCH);
+    return 1;
+  }
+
   Lexer_State state;
   lexer_state_read_file(&state, "max.it");
   AST_Arena arena = {0};
-  AST program;
+  AST program = {0};
+  arena_init(&symbol_arena);
 
   TIME_REGION("parsed", { parse_program(&state, &arena, &program); });
 
@@ -50,18 +130,24 @@ int main(int argc, char *argv[]) {
 
   if (1) {
     printf("dependency graph:\n");
-    print_graph(&graph);
+    print_graph(&registry, &graph);
   }
 
 
-  Vector thir_symbols;
+  Query_Engine engine;
   arena_init(&thir_arena);
-  vector_init(&thir_symbols, sizeof(THIRSymbol));
+  arena_init(&string_pool.arena);
+  vector_init(&string_pool.strings, sizeof(String));
+  query_engine_init(&engine, &program);
   initialize_type_system();
 
   THIR *thir;
   TIME_REGION("generating THIR", {
-    thir = generate_thir(&graph, &registry, &thir_symbols);
+    if (demand_typing) {
+      thir = generate_thir_on_demand(&engine);
+    } else {
+      thir = generate_thir(&engine);
+    }
   });
 
   if (0) {
@@ -70,12 +156,94 @@ int main(int argc, char *argv[]) {
     printf("\033[0m");
   }
 
-  TIME_REGION("generated LLVM IR", {
-    LLVM_Emit_Context ctx;
-    emit_thir_program(&ctx, thir);
-  });
-  
-  TIME_REGION("compiled LLVM IR", { system("clang -g -lc generated/output.ll -o generated/output"); });
+  Inline_Stats inlined;
+  TIME_REGION("inlined leaf functions", { inlined = inline_thir(thir); });
+  printf("inlined %zu of %zu call sites, cloning %zu THIR nodes\n", inlined.inlined, inlined.call_sites,
+         inlined.cloned_nodes);
+
+  size_t folded;
+  TIME_REGION("folded constants", { folded = fold_thir(thir); });
+  printf("constant folding eliminated %zu THIR nodes\n", folded);
+
+  LLVM_Session session;
+  TIME_REGION("initialized LLVM", { llvm_session_init(&session); });
+  LLVM_Program emitted;
+  TIME_REGION("generated LLVM IR", { emit_thir_program(&session, &emitted, thir); });
+  printf("emitted %zu functions into %zu partitions\n", emitted.functions.length, emitted.partition_count);
+  if (LTO || EMIT_KIND == EMIT_BITCODE) {
+    TIME_REGION(LTO ? "link time optimized" : "merged partitions", { merge_emitted_program(&emitted); });
+  }
+  // the reports only need what's been emitted, so they're the same whether the program is run or written.
+  collect_emission_times(&registry, &emitted.functions);
+
+  if (dep_graph_format != DEP_GRAPH_FORMAT_NONE) {
+    const char *path = dep_graph_format == DEP_GRAPH_FORMAT_DOT ? "generated/dep_graph.dot" : "generated/dep_graph.json";
+    FILE *file = fopen(path, "w");
+    if (!file) {
+      panic("Failed to open dependency graph output file");
+    }
+    if (dep_graph_format == DEP_GRAPH_FORMAT_DOT) {
+      write_dep_graph_dot(&registry, file);
+    } else {
+      write_dep_graph_json(&registry, file);
+    }
+    fclose(file);
+  }
+
+  if (report_critical) {
+    report_critical_path(&registry);
+  }
+
+  if (const_stats) {
+    const_eval_print_stats(&engine.const_eval);
+  }
+
+  if (arena_stats) {
+    arena_print_stats("symbol arena", &symbol_arena);
+    arena_print_stats("dependency graph arena", &registry.arena);
+    arena_print_stats("THIR arena", &thir_arena);
+    arena_print_stats("string pool arena", &string_pool.arena);
+    ForEach(Query_Worker *, worker, engine.workers, {
+      char label[64];
+      snprintf(label, sizeof(label), "THIR arena of typing worker %d", i);
+      arena_print_stats(label, &worker->arena);
+    });
+    arena_print_stats("query arena", &engine.arena);
+  }
+
+  // last, it leaves every query to be recomputed.
+  if (check_invalidation) {
+    size_t reset;
+    TIME_REGION("checked invalidation", { reset = query_check_invalidation(&engine); });
+    printf("invalidating every declaration reset %zu of %zu queries\n", reset, engine.queries.length);
+  }
+
+  if (EMIT_KIND == EMIT_JIT) {
+    int status;
+    TIME_REGION("JIT compiled & ran the program", { status = run_emitted_program(&emitted); });
+    llvm_session_free(&session);
+    return status;
+  }
+  const char *written = EMIT_KIND == EMIT_OBJECT ? "generated object code"
+                        : EMIT_KIND == EMIT_BITCODE ? "wrote LLVM bitcode"
+                                                    : "wrote LLVM IR";
+  TIME_REGION(written, { write_emitted_program(&emitted); });
+
+  if (EMIT_KIND != EMIT_OBJECT) {
+    free_emitted_program(&emitted);
+    llvm_session_free(&session);
+    return 0;
+  }
+
+  // only the link is left to an outside tool, the objects are already compiled.
+  int link_status;
+  TIME_REGION("linked", { link_status = link_emitted_program(&emitted, "generated/output"); });
+  free_emitted_program(&emitted);
+  llvm_session_free(&session);
+  if (link_status != 0) {
+    fprintf(stderr, "linking generated/output failed\n");
+    return 1;
+  }
 
   TIME_REGION("executed 'generated/output' binary", { system("./generated/output"); });
   return 0;
@@ -0,0 +1,105 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include "core.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+
+// number of worker threads used by the parallel phases, set with -j. 0 means one per core.
+extern size_t THREAD_COUNT;
+
+#define PARALLEL_MIN_TASKS_PER_THREAD 8
+
+typedef void (*Parallel_Task)(void *user, size_t index);
+// `worker` identifies the thread running the task, for state that's reused across the tasks one thread runs.
+typedef void (*Parallel_Worker_Task)(void *user, size_t worker, size_t index);
+
+typedef struct {
+  Parallel_Task task;
+  Parallel_Worker_Task worker_task;
+  void *user;
+  size_t count;
+  // fewer tasks than this per thread, and there are fewer threads.
+  size_t min_tasks_per_thread;
+  atomic_size_t next;
+  atomic_size_t next_worker;
+} Parallel_For;
+
+static inline size_t parallel_thread_count() {
+  if (THREAD_COUNT) return THREAD_COUNT;
+  long cores = sysconf(_SC_NPROCESSORS_ONLN);
+  return cores > 0 ? (size_t)cores : 1;
+}
+
+static void *parallel_for_worker(void *data) {
+  Parallel_For *work = data;
+  size_t worker = atomic_fetch_add(&work->next_worker, 1);
+  size_t index;
+  while ((index = atomic_fetch_add(&work->next, 1)) < work->count) {
+    if (work->task) {
+      work->task(work->user, index);
+    } else {
+      work->worker_task(work->user, worker, index);
+    }
+  }
+  return nullptr;
+}
+
+static inline size_t parallel_threads_for(size_t count, size_t min_tasks_per_thread) {
+  size_t threads = parallel_thread_count();
+  if (threads > count / min_tasks_per_thread) threads = count / min_tasks_per_thread;
+  return threads ? threads : 1;
+}
+
+// how many threads a parallel_for over `count` tasks runs on.
+static inline size_t parallel_worker_count(size_t count) {
+  // spawning threads costs more than a handful of small tasks, so small inputs just run inline.
+  return parallel_threads_for(count, PARALLEL_MIN_TASKS_PER_THREAD);
+}
+
+static void parallel_run(Parallel_For *work) {
+  size_t threads = parallel_threads_for(work->count, work->min_tasks_per_thread);
+  atomic_init(&work->next, 0);
+  atomic_init(&work->next_worker, 0);
+  if (threads == 1) {
+    parallel_for_worker(work);
+    return;
+  }
+
+  // the calling thread is one of the workers.
+  pthread_t workers[threads - 1];
+  for (size_t i = 0; i < threads - 1; ++i) {
+    if (pthread_create(&workers[i], nullptr, parallel_for_worker, work)) {
+      panic("Failed to create worker thread");
+    }
+  }
+  parallel_for_worker(work);
+  for (size_t i = 0; i < threads - 1; ++i) {
+    pthread_join(workers[i], nullptr);
+  }
+}
+
+// runs task(user, i) for every i in [0, count), spread across the worker threads.
+// tasks are handed out one index at a time, so ordering between them is not guaranteed,
+// anything that has to be deterministic should write to a per-index slot and be merged afterwards.
+static void parallel_for(size_t count, void *user, Parallel_Task task) {
+  Parallel_For work = {
+      .task = task, .user = user, .count = count, .min_tasks_per_thread = PARALLEL_MIN_TASKS_PER_THREAD};
+  parallel_run(&work);
+}
+
+// parallel_for for a few tasks that are each big enough to be worth a thread of their own.
+static void parallel_for_each_thread(size_t count, void *user, Parallel_Task task) {
+  Parallel_For work = {.task = task, .user = user, .count = count, .min_tasks_per_thread = 1};
+  parallel_run(&work);
+}
+
+// parallel_for, where each task also gets its worker's index in [0, parallel_worker_count(count)).
+static void parallel_for_workers(size_t count, void *user, Parallel_Worker_Task task) {
+  Parallel_For work = {
+      .worker_task = task, .user = user, .count = count, .min_tasks_per_thread = PARALLEL_MIN_TASKS_PER_THREAD};
+  parallel_run(&work);
+}
+
+#endif
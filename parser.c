@@ -67,7 +67,8 @@ AST *parse_expression(AST_Arena *arena, Lexer_State *state, AST *parent) {
   }
   case TOKEN_NUMBER: {
     AST *node = ast_arena_alloc(state, arena, AST_NODE_NUMBER, parent);
-    node->number = token.value;
+    node->number.value = token.number;
+    node->number.suffix = token.suffix;
     return node;
   }
   default: {
@@ -77,15 +78,115 @@ AST *parse_expression(AST_Arena *arena, Lexer_State *state, AST *parent) {
   }
 }
 
+typedef struct {
+  char data[256];
+  int length;
+} Type_Name_Builder;
+
+static void type_name_append(Type_Name_Builder *builder, String string) {
+  if (builder->length + string.length >= sizeof(builder->data)) {
+    panic("type name too long");
+  }
+  memcpy(builder->data + builder->length, string.data, string.length);
+  builder->length += string.length;
+}
+
+// Type names are kept as canonical strings with no whitespace, like "Pair<Vec<i32>,f32>".
+// `>>` lexes as a shift, so closing two argument lists at once leaves one pending for the caller.
+static bool try_parse_type_name_into(Lexer_State *state, Type_Name_Builder *builder, int *pending_closes) {
+  if (token_peek(state).type != TOKEN_IDENTIFIER) {
+    return false;
+  }
+  type_name_append(builder, token_eat(state).value);
+  if (token_peek(state).type != TOKEN_LT) {
+    return true;
+  }
+  token_eat(state);
+  type_name_append(builder, (String){"<", 1});
+
+  while (1) {
+    if (!try_parse_type_name_into(state, builder, pending_closes)) {
+      return false;
+    }
+    if (*pending_closes) {
+      (*pending_closes)--;
+      type_name_append(builder, (String){">", 1});
+      return true;
+    }
+
+    Token_Type next = token_peek(state).type;
+    if (next == TOKEN_COMMA) {
+      token_eat(state);
+      type_name_append(builder, (String){",", 1});
+    } else if (next == TOKEN_GT || next == TOKEN_SHR) {
+      token_eat(state);
+      type_name_append(builder, (String){">", 1});
+      if (next == TOKEN_SHR) (*pending_closes)++;
+      return true;
+    } else {
+      return false;
+    }
+  }
+}
+
+static bool try_parse_type_name(Lexer_State *state, String *name) {
+  Type_Name_Builder builder = {0};
+  int pending_closes = 0;
+  if (!try_parse_type_name_into(state, &builder, &pending_closes) || pending_closes) {
+    return false;
+  }
+  *name = String_new(builder.data, builder.length);
+  return true;
+}
+
+String parse_type_name(Lexer_State *state) {
+  String name;
+  if (!try_parse_type_name(state, &name)) {
+    parse_panic(state->location, "expected a type name");
+  }
+  return name;
+}
+
+// <T, U: Constraint, ...> after `fn` or `type`. constraints are parsed, but not checked yet.
+static void parse_generic_parameters(Lexer_State *state, Vector *parameters) {
+  vector_init(parameters, sizeof(String));
+  if (token_peek(state).type != TOKEN_LT) {
+    return;
+  }
+  token_eat(state);
+  while (token_peek(state).type != TOKEN_GT) {
+    String name = token_expect(state, TOKEN_IDENTIFIER).value;
+    vector_push(parameters, &name);
+    if (token_peek(state).type == TOKEN_COLON) {
+      token_eat(state);
+      token_expect(state, TOKEN_IDENTIFIER);
+    }
+    if (token_peek(state).type != TOKEN_GT) {
+      token_expect(state, TOKEN_COMMA);
+    }
+  }
+  token_eat(state);
+}
+
 AST *parse_function_declaration(AST_Arena *arena, Lexer_State *state,
                                 AST *parent) {
   token_expect(state, TOKEN_FN_KEYWORD);
+  Vector generic_parameters;
+  parse_generic_parameters(state, &generic_parameters);
   String name = token_expect(state, TOKEN_IDENTIFIER).value;
   AST *node =
       ast_arena_alloc(state, arena, AST_NODE_FUNCTION_DECLARATION, parent);
+  node->function.generic_parameters = generic_parameters;
   vector_init(&node->function.parameters, sizeof(AST_Parameter));
   node->function.is_entry = false;
   node->function.is_extern = false;
+  node->function.is_export = false;
+  node->function.is_const = false;
+  node->function.is_inline = false;
+  node->function.is_noinline = false;
+  node->function.is_optnone = false;
+  node->function.is_minsize = false;
+  node->function.is_cold = false;
   node->function.name = name;
   token_expect(state, TOKEN_OPEN_PAREN);
 
@@ -99,7 +200,7 @@ AST *parse_function_declaration(AST_Arena *arena, Lexer_State *state,
       token_eat(state);
       param.is_vararg = true;
     } else {
-      param.type = token_expect(state, TOKEN_IDENTIFIER).value;
+      param.type = parse_type_name(state);
       if (token_peek(state).type != TOKEN_COMMA &&
           token_peek(state).type != TOKEN_CLOSE_PAREN) {
         param.name = token_expect(state, TOKEN_IDENTIFIER).value;
@@ -115,7 +216,7 @@ AST *parse_function_declaration(AST_Arena *arena, Lexer_State *state,
   token_eat(state); // Consume ')'
 
   if (token_peek(state).type == TOKEN_IDENTIFIER) {
-    node->function.return_type = token_eat(state).value;
+    node->function.return_type = parse_type_name(state);
   } else {
     node->function.return_type = (String){.data = "void", .length = 4};
   }
@@ -127,6 +228,20 @@ AST *parse_function_declaration(AST_Arena *arena, Lexer_State *state,
       node->function.is_extern = true;
     } else if (String_equals(key, "entry")) {
       node->function.is_entry = true;
+    } else if (String_equals(key, "export")) {
+      node->function.is_export = true;
+    } else if (String_equals(key, "const")) {
+      node->function.is_const = true;
+    } else if (String_equals(key, "inline")) {
+      node->function.is_inline = true;
+    } else if (String_equals(key, "noinline")) {
+      node->function.is_noinline = true;
+    } else if (String_equals(key, "optnone")) {
+      node->function.is_optnone = true;
+    } else if (String_equals(key, "minsize")) {
+      node->function.is_minsize = true;
+    } else if (String_equals(key, "cold")) {
+      node->function.is_cold = true;
     } else {
       parse_panic(state->location,
                   "unexpected identifier for '@...' @tribute :PPP");
@@ -147,13 +262,14 @@ AST *parse_function_declaration(AST_Arena *arena, Lexer_State *state,
 AST *parse_type_declaration(AST_Arena *arena, Lexer_State *state, AST *parent) {
   token_expect(state, TOKEN_TYPE_KEYWORD);
   AST *node = ast_arena_alloc(state, arena, AST_NODE_TYPE_DECLARATION, parent);
+  parse_generic_parameters(state, &node->declaration.generic_parameters);
   vector_init(&node->declaration.members, sizeof(AST_Type_Member));
   String name = token_expect(state, TOKEN_IDENTIFIER).value;
   token_expect(state, TOKEN_OPEN_PAREN);
   node->declaration.name = name;
   while (token_peek(state).type != TOKEN_CLOSE_PAREN) {
     AST_Type_Member member;
-    member.type = token_expect(state, TOKEN_IDENTIFIER).value;
+    member.type = parse_type_name(state);
     member.name = token_expect(state, TOKEN_IDENTIFIER).value;
 
     vector_push(&node->declaration.members, &member);
@@ -196,8 +312,17 @@ AST *parse_next_statement(AST_Arena *arena, Lexer_State *state, AST *parent) {
     return node;
   }
   case TOKEN_IDENTIFIER: {
-    if (token_lookahead(state, 1).type == TOKEN_IDENTIFIER) {
-      String type = token_eat(state).value;
+    // `Pair<i32> x` starts out looking like a comparison, so generic types are parsed speculatively.
+    String type;
+    bool is_declaration = token_lookahead(state, 1).type == TOKEN_IDENTIFIER;
+    if (!is_declaration && token_lookahead(state, 1).type == TOKEN_LT) {
+      Lexer_State saved = *state;
+      is_declaration = try_parse_type_name(state, &type) && token_peek(state).type == TOKEN_IDENTIFIER;
+      *state = saved;
+    }
+
+    if (is_declaration) {
+      type = parse_type_name(state);
       String name = token_expect(state, TOKEN_IDENTIFIER).value;
 
       AST *var_decl_node = ast_arena_alloc(state, arena, AST_NODE_VARIABLE_DECLARATION, parent);
@@ -208,6 +333,15 @@ AST *parse_next_statement(AST_Arena *arena, Lexer_State *state, AST *parent) {
       if (token_peek(state).type == TOKEN_ASSIGN) {
         token_eat(state);
         var_decl_node->variable.value = parse_binary_expression(arena, state, var_decl_node);
+
+        if (token_peek(state).type == TOKEN_AT) {
+          token_eat(state);
+          auto key = token_expect(state, TOKEN_IDENTIFIER).value;
+          if (!String_equals(key, "const")) {
+            parse_panic(state->location, "unexpected identifier for '@...' @tribute :PPP");
+          }
+          var_decl_node->variable.is_const = true;
+        }
       }
 
       token_expect(state, TOKEN_SEMICOLON);
@@ -250,7 +384,8 @@ void insert_symbol(AST *scope, String name, AST *node, Type *type) {
   while (symbol->next) {
     symbol = symbol->next;
   }
-  symbol->next = malloc(sizeof(Symbol));
+  symbol->next = ARENA_ALLOC(&symbol_arena, Symbol);
+  *symbol->next = (Symbol){0};
   symbol->next->name = name;
   symbol->next->node = node;
   if (type) {
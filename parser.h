@@ -31,10 +31,11 @@ static const char *Node_Kind_String[] = {
   "AST_NODE_FUNCTION_DECLARATION",
   "AST_NODE_TYPE_DECLARATION",
   "AST_NODE_VARIABLE_DECLARATION",
-  "AST_NODE_ASSIGNMENT",
   "AST_NODE_DOT_EXPRESSION",
   "AST_NODE_FUNCTION_CALL",
   "AST_NODE_BLOCK",
+  "AST_NODE_BINARY_EXPRESSION",
+  "AST_NODE_RETURN",
 };
 
 typedef struct {
@@ -72,6 +73,8 @@ typedef struct AST {
   Symbol symbol_table;
   Source_Location location;
   struct AST *parent;
+  // the dependency graph node created for this declaration, if any.
+  struct DepNode *dep_node;
 
   union {
     struct {
@@ -80,16 +83,27 @@ typedef struct AST {
 
       // todo: add function flags?
       bool is_extern : 1, 
-           is_entry : 1;
+           is_entry : 1,
+           is_export : 1,
+           is_const : 1,
+           is_inline : 1,
+           is_noinline : 1,
+           is_optnone : 1,
+           is_minsize : 1,
+           is_cold : 1;
 
       Vector parameters;
       struct AST *block;
+      // Vector<String>, the names in fn<T, ...>. empty unless this is a generic.
+      Vector generic_parameters;
     } function;
 
     struct {
       String type;
       String name;
       struct AST *value;
+      // @const, the value is computed once at compile time.
+      bool is_const;
     } variable;
 
     struct {
@@ -100,6 +114,8 @@ typedef struct AST {
     struct {
       String name;
       Vector members;
+      // Vector<String>, the names in type<T, ...>. empty unless this is a generic.
+      Vector generic_parameters;
     } declaration;
 
     struct {
@@ -117,7 +133,11 @@ typedef struct AST {
     AST_List statements;
     String string;
     String identifier;
-    String number;
+
+    struct {
+      u64 value;
+      Number_Suffix suffix;
+    } number;
   };
 } AST;
 
@@ -149,6 +169,9 @@ static int64_t get_parameter_index(AST *node, String name) {
   return -1;
 }
 
+// backing storage for every Symbol inserted by the parser.
+extern Arena symbol_arena;
+
 Symbol *find_symbol(AST *scope, String name);
 
 void insert_symbol(AST *scope, String name, AST *node, Type *type);
@@ -162,6 +185,7 @@ typedef struct AST_Arena {
 static inline AST *ast_arena_alloc(Lexer_State* state, AST_Arena *arena, AST_Node_Kind kind, AST *parent) {
   if (arena->nodes_length < 1024) {
     AST *node = &arena->nodes[arena->nodes_length++];
+    memset(node, 0, sizeof(AST));
     node->kind = kind;
     node->type = 0;
     node->location = state->location;
@@ -185,6 +209,24 @@ static void ast_arena_free(AST_Arena *arena) {
   }
 }
 
+// a generic function or type, only ever typed through its instances.
+static inline bool ast_is_generic(AST *node) {
+  switch (node->kind) {
+    case AST_NODE_FUNCTION_DECLARATION:
+      return node->function.generic_parameters.length > 0;
+    case AST_NODE_TYPE_DECLARATION:
+      return node->declaration.generic_parameters.length > 0;
+    default:
+      return false;
+  }
+}
+
+static inline Vector *ast_generic_parameters(AST *node) {
+  return node->kind == AST_NODE_FUNCTION_DECLARATION ? &node->function.generic_parameters
+                                                     : &node->declaration.generic_parameters;
+}
+
+String parse_type_name(Lexer_State *state);
 AST *parse_next_statement(AST_Arena *arena, Lexer_State *state, AST *parent);
 AST *parse_block(AST_Arena *arena, Lexer_State *state, AST *parent);
 AST *parse_expression(AST_Arena *arena, Lexer_State *state, AST *parent);
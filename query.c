@@ -0,0 +1,357 @@
+#include "query.h"
+#include "core.h"
+#include "graph.h"
+#include "parser.h"
+
+static u64 query_hash(Query_Kind kind, AST *declaration, Instance *instance) {
+  struct {
+    AST *declaration;
+    Instance *instance;
+    u64 kind;
+  } key = {declaration, instance, kind};
+  return hash_bytes(&key, sizeof(key));
+}
+
+// the body phase's worker on worker threads, nullptr on the main thread.
+static thread_local Query_Worker *current_worker;
+thread_local u32 query_lock_depth;
+
+static void query_worker_init(Query_Worker *worker) {
+  vector_init(&worker->stack, sizeof(Query_Frame));
+  thir_symbol_table_init(&worker->locals);
+  arena_init(&worker->arena);
+}
+
+static void query_worker_free(Query_Worker *worker) {
+  vector_free(&worker->stack);
+  thir_symbol_table_free(&worker->locals);
+  arena_free(&worker->arena);
+}
+
+Query_Worker *query_worker(Query_Engine *engine) {
+  return current_worker ? current_worker : &engine->worker;
+}
+
+bool query_is_running_here(Query_Engine *engine, Query *query) {
+  if (!query) return false;
+  query_lock(engine);
+  bool running = query->state == QUERY_IN_PROGRESS && query->owner == query_worker(engine);
+  query_unlock(engine);
+  return running;
+}
+
+void query_enter_worker(Query_Worker *worker) {
+  current_worker = worker;
+  thir_allocator = worker ? &worker->arena : &thir_arena;
+}
+
+Query_Worker *query_get_worker(Query_Engine *engine, size_t index) {
+  while (engine->workers.length <= index) {
+    Query_Worker *worker = malloc(sizeof(Query_Worker));
+    query_worker_init(worker);
+    vector_push(&engine->workers, &worker);
+  }
+  return V_AT(Query_Worker *, engine->workers, index);
+}
+
+static bool is_declaration(AST *node) {
+  return node->kind == AST_NODE_FUNCTION_DECLARATION || node->kind == AST_NODE_TYPE_DECLARATION;
+}
+
+void query_engine_init(Query_Engine *engine, AST *program) {
+  *engine = (Query_Engine){.program = program};
+  pthread_mutexattr_t attributes;
+  pthread_mutexattr_init(&attributes);
+  pthread_mutexattr_settype(&attributes, PTHREAD_MUTEX_RECURSIVE);
+  pthread_mutex_init(&engine->lock, &attributes);
+  pthread_mutexattr_destroy(&attributes);
+  pthread_cond_init(&engine->finished, nullptr);
+
+  arena_init(&engine->arena);
+  vector_init(&engine->queries, sizeof(Query *));
+  vector_init(&engine->completed, sizeof(THIR *));
+  vector_init(&engine->instances, sizeof(Instance *));
+  vector_init(&engine->workers, sizeof(Query_Worker *));
+  query_worker_init(&engine->worker);
+  const_eval_init(&engine->const_eval);
+
+  for (size_t i = 0; i < program->statements.length; ++i) {
+    AST *statement = program->statements.data[i];
+    if (statement->kind == AST_NODE_FUNCTION_DECLARATION) {
+      hash_index_insert(&engine->declarations, hash_string(statement->function.name), i);
+    } else if (statement->kind == AST_NODE_TYPE_DECLARATION) {
+      hash_index_insert(&engine->declarations, hash_string(statement->declaration.name), i);
+    }
+  }
+}
+
+void query_engine_free(Query_Engine *engine) {
+  ForEach(Query *, query, engine->queries, {
+    vector_free(&query->dependencies);
+    vector_free(&query->dependents);
+  });
+  vector_free(&engine->queries);
+  vector_free(&engine->completed);
+  vector_free(&engine->instances);
+  hash_index_free(&engine->instance_index);
+  hash_index_free(&engine->index);
+  hash_index_free(&engine->declarations);
+  const_eval_free(&engine->const_eval);
+  arena_free(&engine->arena);
+  query_worker_free(&engine->worker);
+  ForEach(Query_Worker *, worker, engine->workers, {
+    query_worker_free(worker);
+    free(worker);
+  });
+  vector_free(&engine->workers);
+  pthread_mutex_destroy(&engine->lock);
+  pthread_cond_destroy(&engine->finished);
+}
+
+Query *query_find(Query_Engine *engine, Query_Kind kind, AST *declaration, Instance *instance) {
+  size_t cursor = 0, index;
+  u64 hash = query_hash(kind, declaration, instance);
+  Query *found = nullptr;
+  query_lock(engine);
+  while ((index = hash_index_next(&engine->index, hash, &cursor)) != HASH_INDEX_END) {
+    Query *query = V_AT(Query *, engine->queries, index);
+    if (query->kind == kind && query->declaration == declaration && query->instance == instance) {
+      found = query;
+      break;
+    }
+  }
+  query_unlock(engine);
+  return found;
+}
+
+static void query_add_edge(Query *dependent, Query *dependency) {
+  ForEach(Query *, existing, dependent->dependencies, {
+    if (existing == dependency) return;
+  });
+  vector_push(&dependent->dependencies, &dependency);
+  vector_push(&dependency->dependents, &dependent);
+}
+
+Query *query_begin(Query_Engine *engine, Query_Kind kind, AST *declaration, Instance *instance, bool *cached) {
+  Query *query = query_find(engine, kind, declaration, instance);
+  if (!query) {
+    query = ARENA_ALLOC(&engine->arena, Query);
+    *query = (Query){.kind = kind, .declaration = declaration, .instance = instance};
+    vector_init(&query->dependencies, sizeof(Query *));
+    vector_init(&query->dependents, sizeof(Query *));
+    hash_index_insert(&engine->index, query_hash(kind, declaration, instance), engine->queries.length);
+    vector_push(&engine->queries, &query);
+  }
+
+  Query_Worker *worker = query_worker(engine);
+  Vector *stack = &worker->stack;
+  if (stack->length) {
+    query_add_edge((V_PTR_BACK(Query_Frame, (*stack)))->query, query);
+  }
+
+  // another worker running it isn't a cycle, unless what that worker is waiting on leads back to this one.
+  while (query->state == QUERY_IN_PROGRESS) {
+    for (Query_Worker *owner = query->owner; owner; owner = owner->waiting ? owner->waiting->owner : nullptr) {
+      if (owner == worker) {
+        parse_panic(declaration->location, "cyclic dependency detected");
+      }
+    }
+    // bodies are the only queries that run without the lock, and the wait only gives it up once.
+    // anything holding it deeper (compile time evaluation) would keep the owner from ever finishing.
+    if (query_lock_depth != 1) {
+      parse_panic(declaration->location, "waiting on a body another worker is typing while holding the query lock");
+    }
+    worker->waiting = query;
+    query_lock_depth = 0;
+    pthread_cond_wait(&engine->finished, &engine->lock);
+    query_lock_depth = 1;
+    worker->waiting = nullptr;
+  }
+
+  if (query->state == QUERY_DONE) {
+    *cached = true;
+    return query;
+  }
+
+  *cached = false;
+  query->state = QUERY_IN_PROGRESS;
+  query->owner = worker;
+  vector_push(stack, &(Query_Frame){.query = query, .start = time_now()});
+  return query;
+}
+
+void query_end(Query_Engine *engine, Query *query, THIR *result) {
+  Vector *stack = &query_worker(engine)->stack;
+  Query_Frame frame = V_BACK(Query_Frame, (*stack));
+  stack->length--;
+  if (frame.query != query) {
+    panic("query_end called out of order");
+  }
+
+  double elapsed = time_now() - frame.start;
+  query->time = elapsed - frame.children;
+  if (stack->length) {
+    (V_PTR_BACK(Query_Frame, (*stack)))->children += elapsed;
+  }
+
+  // the first query to produce a declaration's THIR puts it in the program.
+  if (query->kind != QUERY_BODY_THIR && !query->result) {
+    vector_push(&engine->completed, &result);
+  }
+
+  query->result = result;
+  query->state = QUERY_DONE;
+  query->owner = nullptr;
+  pthread_cond_broadcast(&engine->finished);
+
+  // attribute the cost to the dependency graph, for --emit-dep-graph & --critical-path.
+  // instances count towards their generic, which has no THIR of its own.
+  DepNode *dep_node = query->declaration->dep_node;
+  if (dep_node) {
+    dep_node->typing_time += query->time;
+    dep_node->state = RESOLVED;
+    if (!query->instance) {
+      dep_node->thir = result;
+    }
+  }
+}
+
+static size_t query_invalidate_recursive(Query *query) {
+  if (query->state == QUERY_NOT_STARTED) {
+    return 0;
+  }
+  query->state = QUERY_NOT_STARTED;
+  size_t reset = 1;
+  // each dependent unlinks itself from this query's dependents as it's reset, so walk a copy.
+  size_t count = query->dependents.length;
+  Query **dependents = malloc(count * sizeof(Query *) + 1);
+  memcpy(dependents, query->dependents.data, count * sizeof(Query *));
+  for (size_t i = 0; i < count; ++i) {
+    reset += query_invalidate_recursive(dependents[i]);
+  }
+  free(dependents);
+  // it'll record fresh dependencies when it runs again.
+  ForEach(Query *, dependency, query->dependencies, {
+    for (size_t j = 0; j < dependency->dependents.length; ++j) {
+      if (V_AT(Query *, dependency->dependents, j) == query) {
+        V_AT(Query *, dependency->dependents, j) = V_BACK(Query *, dependency->dependents);
+        dependency->dependents.length--;
+        break;
+      }
+    }
+  });
+  query->dependencies.length = 0;
+  return reset;
+}
+
+size_t query_invalidate(Query_Engine *engine, AST *declaration) {
+  Query_Kind kinds[] = {QUERY_SIGNATURE_OF, QUERY_LAYOUT_OF, QUERY_BODY_THIR};
+  size_t reset = 0;
+  query_lock(engine);
+  for (size_t i = 0; i < sizeof(kinds) / sizeof(kinds[0]); ++i) {
+    Query *query = query_find(engine, kinds[i], declaration, nullptr);
+    if (query) {
+      reset += query_invalidate_recursive(query);
+    }
+    ForEach(Instance *, instance, engine->instances, {
+      if (instance->declaration == declaration && (query = query_find(engine, kinds[i], declaration, instance))) {
+        reset += query_invalidate_recursive(query);
+      }
+    });
+  }
+  query_unlock(engine);
+  return reset;
+}
+
+size_t query_check_invalidation(Query_Engine *engine) {
+  size_t reset = 0;
+  for (size_t i = 0; i < engine->program->statements.length; ++i) {
+    AST *statement = engine->program->statements.data[i];
+    if (!is_declaration(statement)) continue;
+    reset += query_invalidate(engine, statement);
+    // a query that's still done can't have read one that's been reset.
+    ForEach(Query *, query, engine->queries, {
+      if (query->state != QUERY_DONE) continue;
+      ForEach(Query *, dependency, query->dependencies, {
+        if (dependency->state == QUERY_NOT_STARTED) {
+          panic("invalidation left a query that read an invalidated one done");
+        }
+      });
+    });
+  }
+  return reset;
+}
+
+AST *query_find_declaration(Query_Engine *engine, AST *scope, String name) {
+  // nested scopes are small, walk them the way the parser does.
+  for (; scope && scope != engine->program; scope = scope->parent) {
+    for (Symbol *symbol = scope->symbol_table.next; symbol; symbol = symbol->next) {
+      if (symbol->node && is_declaration(symbol->node) && Strings_compare(symbol->name, name)) {
+        return symbol->node;
+      }
+    }
+  }
+
+  size_t cursor = 0, index;
+  while ((index = hash_index_next(&engine->declarations, hash_string(name), &cursor)) != HASH_INDEX_END) {
+    AST *declaration = engine->program->statements.data[index];
+    String declared = declaration->kind == AST_NODE_FUNCTION_DECLARATION ? declaration->function.name
+                                                                         : declaration->declaration.name;
+    if (Strings_compare(declared, name)) {
+      return declaration;
+    }
+  }
+  return nullptr;
+}
+
+static u64 instance_hash(AST *generic, size_t *arguments, size_t count) {
+  return hash_bytes(arguments, count * sizeof(size_t)) ^ hash_bytes(&generic, sizeof(generic));
+}
+
+Instance *query_instantiate(Query_Engine *engine, AST *generic, size_t *arguments) {
+  size_t count = ast_generic_parameters(generic)->length;
+  u64 hash = instance_hash(generic, arguments, count);
+
+  size_t cursor = 0, index;
+  query_lock(engine);
+  while ((index = hash_index_next(&engine->instance_index, hash, &cursor)) != HASH_INDEX_END) {
+    Instance *instance = V_AT(Instance *, engine->instances, index);
+    if (instance->declaration == generic && memcmp(instance->arguments, arguments, count * sizeof(size_t)) == 0) {
+      query_unlock(engine);
+      return instance;
+    }
+  }
+
+  Instance *instance = ARENA_ALLOC(&engine->arena, Instance);
+  instance->declaration = generic;
+  instance->arguments = ARENA_ALLOC_ARRAY(&engine->arena, size_t, count);
+  memcpy(instance->arguments, arguments, count * sizeof(size_t));
+
+  // Base<Argument,...>, spelled the way the parser canonicalizes type names so the two always agree.
+  String base = generic->kind == AST_NODE_FUNCTION_DECLARATION ? generic->function.name : generic->declaration.name;
+  size_t length = base.length + 2;
+  for (size_t i = 0; i < count; ++i) {
+    length += type_to_string(get_type(arguments[i])).length + 1;
+  }
+  char *name = ARENA_ALLOC_ARRAY(&engine->arena, char, length);
+  int offset = sprintf(name, "%.*s<", base.length, base.data);
+  for (size_t i = 0; i < count; ++i) {
+    String argument = type_to_string(get_type(arguments[i]));
+    offset += sprintf(name + offset, "%s%.*s", i ? "," : "", argument.length, argument.data);
+  }
+  offset += sprintf(name + offset, ">");
+  instance->name = (String){.data = name, .length = offset};
+
+  hash_index_insert(&engine->instance_index, hash, engine->instances.length);
+  vector_push(&engine->instances, &instance);
+  query_unlock(engine);
+  return instance;
+}
+
+Instance *query_current_instance(Query_Engine *engine) {
+  Vector *stack = &query_worker(engine)->stack;
+  if (!stack->length) {
+    return nullptr;
+  }
+  return (V_PTR_BACK(Query_Frame, (*stack)))->query->instance;
+}
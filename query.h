@@ -0,0 +1,159 @@
+#ifndef QUERY_H
+#define QUERY_H
+
+#include "const_eval.h"
+#include "core.h"
+#include "parser.h"
+#include "thir.h"
+#include <pthread.h>
+
+// Semantic analysis is a set of memoized queries over declarations, e.g. "the signature of fn main".
+// Each query runs at most once, caches its result, and records every other query it read while running.
+// Ordering falls out of that naturally: a query just asks for what it needs, so there's no topological sort,
+// and a query reached again while it's still running is a real cycle.
+// The recorded edges are kept in both directions, so invalidating a query can find everything that read it.
+
+typedef enum : u8 {
+  QUERY_SIGNATURE_OF, // THIR_FUNCTION with its parameters & function type, no body.
+  QUERY_LAYOUT_OF,    // THIR_TYPE_DECLARATION, with its struct type & members resolved.
+  QUERY_BODY_THIR,    // the signature's THIR_FUNCTION, with its body typed.
+} Query_Kind;
+
+// One monomorphization of a generic function or type: the generic declaration with a type for each
+// of its parameters. Instances are unique program wide, and each has its own set of queries,
+// so it's typed on first use and emitted once however many places spell it out.
+typedef struct Instance {
+  AST *declaration;
+  size_t *arguments; // type ids, one per generic parameter.
+  // the canonical name, like "Pair<i32>". it names the struct type for type instances,
+  // and is the (quoted) symbol of function instances, which keeps them distinct in the module.
+  String name;
+} Instance;
+
+typedef enum : u8 {
+  QUERY_NOT_STARTED,
+  QUERY_IN_PROGRESS,
+  QUERY_DONE,
+} Query_State;
+
+typedef struct Query {
+  Query_Kind kind;
+  Query_State state;
+  AST *declaration;
+  Instance *instance; // nullptr unless declaration is a generic.
+  THIR *result;
+  // the worker running it while it's QUERY_IN_PROGRESS.
+  struct Query_Worker *owner;
+
+  Vector dependencies; // Vector<Query *>, the queries this one read.
+  Vector dependents;   // Vector<Query *>, the queries that read this one.
+
+  // time spent in this query itself, not counting the queries it ran.
+  double time;
+} Query;
+
+typedef struct {
+  Query *query;
+  double start;
+  double children;
+} Query_Frame;
+
+// What a thread needs to type a body by itself. Bodies only read signatures & layouts, so once those are
+// known each one can be typed on a worker with its own running queries, locals and THIR arena, and only the
+// shared query state below has to go through the engine's lock.
+typedef struct Query_Worker {
+  Vector stack;           // Vector<Query_Frame>, the queries this thread is running, innermost at the back.
+  THIRSymbolTable locals; // locals & parameters of the body being typed.
+  THIR *function;         // the function whose body is being typed, for what its returns are typed as.
+  Query *waiting;         // a query another worker is running, that this one is waiting on.
+  Arena arena;            // THIR typed by this worker, the main thread allocates from thir_arena instead.
+} Query_Worker;
+
+typedef struct Query_Engine {
+  // Everything from here to `const_eval` is shared by every worker, and only touched with `lock` held.
+  // It's recursive, since a query holds it while it runs and the queries it asks for take it again.
+  pthread_mutex_t lock;
+  // signalled whenever a query finishes, for workers waiting on one another worker is running.
+  pthread_cond_t finished;
+
+  Hash_Index index;    // hash of (kind, declaration, instance) -> index into queries.
+  Vector queries;      // Vector<Query *>
+  Arena arena;
+
+  AST *program;
+  // top level declarations by name, so global lookups don't walk the program's symbol list.
+  // filled in once up front, so reading it doesn't need the lock.
+  Hash_Index declarations;
+
+  Hash_Index instance_index; // hash of (declaration, arguments) -> index into instances.
+  Vector instances;          // Vector<Instance *>
+
+  // Vector<THIR *>, every function & type declaration in the order their queries finished.
+  Vector completed;
+
+  Const_Evaluator const_eval;
+
+  // the main thread's worker state, and the ones the body phase created, Vector<Query_Worker *>.
+  Query_Worker worker;
+  Vector workers;
+} Query_Engine;
+
+void query_engine_init(Query_Engine *engine, AST *program);
+void query_engine_free(Query_Engine *engine);
+
+// how many times the calling thread holds the engine lock. waiting on another worker's query releases it once,
+// which only lets that worker make progress when it isn't held any deeper.
+extern thread_local u32 query_lock_depth;
+
+static inline void query_lock(Query_Engine *engine) {
+  pthread_mutex_lock(&engine->lock);
+  query_lock_depth++;
+}
+static inline void query_unlock(Query_Engine *engine) {
+  query_lock_depth--;
+  pthread_mutex_unlock(&engine->lock);
+}
+
+// the calling thread's worker state.
+Query_Worker *query_worker(Query_Engine *engine);
+// whether `query` is running on the calling thread, i.e. reaching it again from here is recursion.
+bool query_is_running_here(Query_Engine *engine, Query *query);
+// makes the calling thread type with `worker`'s state & arena, nullptr goes back to the engine's own.
+void query_enter_worker(Query_Worker *worker);
+// the engine's `index`th body phase worker, created on first use.
+Query_Worker *query_get_worker(Query_Engine *engine, size_t index);
+
+// Looks up (or creates) the query, and records it as a dependency of the running query.
+// Returns the query with *cached set if its result can be used as is, otherwise the caller
+// must compute the result and finish with query_end. Reaching a query that's still running is a cycle, and errors.
+// Both expect the engine lock to be held.
+Query *query_begin(Query_Engine *engine, Query_Kind kind, AST *declaration, Instance *instance, bool *cached);
+void query_end(Query_Engine *engine, Query *query, THIR *result);
+
+Query *query_find(Query_Engine *engine, Query_Kind kind, AST *declaration, Instance *instance);
+
+// marks the queries on `declaration`, and transitively everything that read them, to be recomputed.
+// returns how many queries were reset.
+size_t query_invalidate(Query_Engine *engine, AST *declaration);
+// invalidates every top level declaration in turn, checking each time that nothing which read a reset query
+// is left done. returns how many queries were reset, for --check-invalidation.
+size_t query_check_invalidation(Query_Engine *engine);
+
+// finds the function or type declaration `name` refers to from `scope`, or nullptr.
+AST *query_find_declaration(Query_Engine *engine, AST *scope, String name);
+
+// the instance of `generic` for `arguments` (one type id per generic parameter), created on first use.
+Instance *query_instantiate(Query_Engine *engine, AST *generic, size_t *arguments);
+
+// the instance the innermost running query is typing, if any. its arguments are what the
+// generic parameter names resolve to.
+Instance *query_current_instance(Query_Engine *engine);
+
+// the queries themselves, implemented by the typer. `instance` is nullptr for non generic declarations.
+THIR *query_signature_of(Query_Engine *engine, AST *function, Instance *instance);
+THIR *query_layout_of(Query_Engine *engine, AST *type_declaration, Instance *instance);
+THIR *query_body_thir(Query_Engine *engine, AST *function, Instance *instance);
+// the type of a function or type declaration.
+size_t query_type_of(Query_Engine *engine, AST *declaration, Instance *instance);
+
+#endif
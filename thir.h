@@ -3,6 +3,7 @@
 #define THIR_H
 
 #include <llvm-c/Types.h>
+#include <pthread.h>
 #include "core.h"
 #include "lexer.h"
 
@@ -17,49 +18,40 @@ typedef enum : u8 {
   THIR_STRING,
   THIR_RETURN,
   THIR_FUNCTION,
+  THIR_PARAMETER,
   THIR_TYPE_DECLARATION,
   THIR_VARIABLE_DECLARATION,
 } THIRKind;
 
-typedef struct {
-  String name;
-  size_t type;
-} THIRMember;
-
-typedef struct {
-  String name;
-  size_t type;
-  bool is_vararg;
-} THIRParameter;
-
 typedef struct THIR THIR;
 
+// children live in one contiguous, exactly sized array in the THIR arena.
 typedef struct {
   THIR **nodes;
-  size_t length;
-  size_t capacity;
+  u32 length;
 } THIRList;
 
-static inline void thir_list_push(THIRList *list, THIR *node) {
-  if (list->length >= list->capacity) {
-    list->capacity = list->capacity ? list->capacity * 4 : 1;
-    list->nodes = realloc(list->nodes, list->capacity * sizeof(THIR *));
-  }
-  list->nodes[list->length++] = node;
-}
-
+// Everything the backend needs is resolved by the typer, so there are no names on
+// references: identifiers point at their declaration, member accesses carry the member index,
+// parameters their slot and calls the callee's function id. Names only live on declarations.
 typedef struct THIR {
-  size_t type;
   THIRKind kind;
+  size_t type;
   Source_Location location;
 
   union {
-    // literals.
-    String number;
-    String string;
+    // literals. numbers are stored as their two's complement bits, and wrapped to the node's type.
+    s64 number;
 
     struct {
-      String name;
+      // unescaped, and the same memory for every literal with the same contents.
+      String value;
+      // index into string_pool.strings.
+      u32 id;
+    } string;
+
+    struct {
+      // a THIR_VARIABLE_DECLARATION, THIR_PARAMETER or THIR_FUNCTION.
       THIR *resolved;
     } identifier;
 
@@ -79,44 +71,151 @@ typedef struct THIR {
 
     struct {
       THIR *base;
-      String member;
+      u32 index;
     } member_access;
 
     struct {
       String name;
-      bool is_extern, is_entry;
+      u32 slot;
+      bool is_vararg;
+    } parameter;
+
+    struct {
+      String name;
+      // dense index of this function in the program, see thir_function_count.
+      u32 id;
+      bool is_extern : 1, is_entry : 1, is_export : 1, is_const : 1, is_inline : 1, is_noinline : 1;
+      // only for LLVM, see add_function_attributes.
+      bool is_optnone : 1, is_minsize : 1, is_cold : 1;
+      // the declaration this was typed from, for when the body is needed before anything asked for it.
+      struct AST *declaration;
+      // the type arguments this was monomorphized with, when the declaration is generic.
+      struct Instance *instance;
       THIR *block;
-      Vector parameters;
-      LLVMValueRef llvm_function;
+      THIRList parameters; // THIR_PARAMETER nodes.
+      double emission_time;
     } function;
 
     struct {
       String name;
+      // for @const variables, the THIR_NUMBER it evaluated to.
       THIR *value;
+      bool is_const;
     } variable;
 
     struct {
       String name;
-      Vector members;
     } type_declaration;
   };
 } THIR;
 
+// number of THIR_FUNCTIONs created so far, function ids are in [0, thir_function_count).
+extern u32 thir_function_count;
+
 typedef struct {
   String name;
+  u64 hash;
   THIR *thir;
+  // 1 + index of the next symbol in the same bucket, which includes anything this one shadows. 0 ends the chain.
+  size_t next;
 } THIRSymbol;
 
-static inline THIRSymbol *find_thir_symbol(Vector *symbols, String name) {
-  ForEachPtr(THIRSymbol, symbol, (*symbols), {
-    if (Strings_compare(symbol->name, name)) {
+// Scoped symbol table, every symbol lives in one hash table and shadowing is handled by
+// chaining newer symbols in front of older ones in the same bucket. Scopes are strictly nested,
+// so popping one just unlinks the symbols declared since the matching push, newest first.
+typedef struct {
+  Vector symbols;  // Vector<THIRSymbol>, in declaration order.
+  Vector scopes;   // Vector<size_t>, symbols.length at each push.
+  size_t *buckets; // 1 + index of the newest symbol in the bucket, 0 when empty.
+  size_t bucket_count;
+} THIRSymbolTable;
+
+static inline void thir_symbol_table_init(THIRSymbolTable *table) {
+  vector_init(&table->symbols, sizeof(THIRSymbol));
+  vector_init(&table->scopes, sizeof(size_t));
+  table->bucket_count = 64;
+  table->buckets = calloc(table->bucket_count, sizeof(size_t));
+}
+
+static inline void thir_symbol_table_free(THIRSymbolTable *table) {
+  vector_free(&table->symbols);
+  vector_free(&table->scopes);
+  free(table->buckets);
+}
+
+static inline void thir_symbol_table_rehash(THIRSymbolTable *table) {
+  table->bucket_count *= 2;
+  table->buckets = realloc(table->buckets, table->bucket_count * sizeof(size_t));
+  memset(table->buckets, 0, table->bucket_count * sizeof(size_t));
+  // relinking in declaration order keeps inner symbols in front of the ones they shadow.
+  ForEachPtr(THIRSymbol, symbol, table->symbols, {
+    size_t bucket = symbol->hash & (table->bucket_count - 1);
+    symbol->next = table->buckets[bucket];
+    table->buckets[bucket] = i + 1;
+  });
+}
+
+static inline void thir_symbols_push_scope(THIRSymbolTable *table) {
+  vector_push(&table->scopes, &table->symbols.length);
+}
+
+static inline void thir_symbols_pop_scope(THIRSymbolTable *table) {
+  size_t start = V_BACK(size_t, table->scopes);
+  table->scopes.length--;
+  while (table->symbols.length > start) {
+    THIRSymbol *symbol = V_PTR_BACK(THIRSymbol, table->symbols);
+    table->buckets[symbol->hash & (table->bucket_count - 1)] = symbol->next;
+    table->symbols.length--;
+  }
+}
+
+static inline void insert_thir_symbol(THIRSymbolTable *table, String name, THIR *thir) {
+  if (table->symbols.length >= table->bucket_count) {
+    thir_symbol_table_rehash(table);
+  }
+  u64 hash = hash_string(name);
+  size_t bucket = hash & (table->bucket_count - 1);
+  vector_push(&table->symbols, &(THIRSymbol){
+                                   .name = name,
+                                   .hash = hash,
+                                   .thir = thir,
+                                   .next = table->buckets[bucket],
+                               });
+  table->buckets[bucket] = table->symbols.length;
+}
+
+// finds the innermost visible symbol named `name`.
+static inline THIRSymbol *find_thir_symbol(THIRSymbolTable *table, String name) {
+  u64 hash = hash_string(name);
+  size_t index = table->buckets[hash & (table->bucket_count - 1)];
+  while (index) {
+    THIRSymbol *symbol = V_PTR_AT(THIRSymbol, table->symbols, index - 1);
+    if (symbol->hash == hash && Strings_compare(symbol->name, name)) {
       return symbol;
     }
-  });
+    index = symbol->next;
+  }
   return nullptr;
 }
 
+// Every string literal in the program, unescaped once when it's typed and interned by contents, so the backend
+// emits one constant per distinct string no matter how many times it's used. Interning locks, the typer
+// runs in parallel, reading an interned string doesn't.
+typedef struct {
+  Hash_Index index; // hash of the contents -> index into strings.
+  Vector strings;   // Vector<String>, NUL terminated, which isn't counted in the length.
+  Arena arena;      // the contents.
+  pthread_mutex_t lock;
+} String_Pool;
+
+extern String_Pool string_pool;
+
+// `source` is the literal as written, without the quotes.
+u32 intern_string_literal(String source, String *value);
+
 extern Arena thir_arena;
+// where the calling thread allocates THIR, thir_arena unless it's a typing worker with an arena of its own.
+extern thread_local Arena *thir_allocator;
 
 inline static void print_indent(int indent) {
   for (int i = 0; i < indent; ++i) printf("  ");
@@ -129,9 +228,16 @@ inline static void print_string(String str) { printf("%.*s", (int)str.length, st
 const char *thir_kind_to_string(THIRKind type);
 void pretty_print_thir(THIR *thir, int indent);
 
+static inline THIRList thir_list_alloc(size_t length) {
+  return (THIRList){
+      .nodes = length ? ARENA_ALLOC_ARRAY(thir_allocator, THIR *, length) : nullptr,
+      .length = length,
+  };
+}
+
 #define THIR_ALLOC(tag, $location)                       \
   ({                                                     \
-    THIR *thir = arena_alloc(&thir_arena, sizeof(THIR)); \
+    THIR *thir = ARENA_ALLOC(thir_allocator, THIR);      \
     memset(thir, 0, sizeof(THIR));                       \
     thir->kind = tag;                                    \
     thir->location = $location;                          \
@@ -4,6 +4,8 @@
 #include "core.h"
 #include <llvm-c/Core.h>
 #include <llvm-c/Types.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdint.h>
 
 typedef struct Type Type;
@@ -13,17 +15,28 @@ typedef struct Member {
   size_t type;
 } Type_Member;
 
+// the builtins are created in this order by initialize_type_system, so their kind is also their type id.
 typedef enum {
   VOID,
   I32,
   F32,
   STRING,
+  I8,
+  I16,
+  I64,
+  U8,
+  U16,
+  U32,
+  U64,
 
   STRUCT,
   FUNCTION,
 } Type_Kind;
 
-extern Vector type_table;
+// named types (builtins & structs), keyed by the hash of their name.
+extern Hash_Index type_name_index;
+// structural function types, keyed by function_type_hash.
+extern Hash_Index function_type_index;
 
 typedef struct AST AST;
 
@@ -31,7 +44,6 @@ typedef struct Type {
   String name;
   Type_Kind kind;
   size_t id;
-  LLVMTypeRef llvm_type;
 
   union {
     struct {
@@ -46,87 +58,130 @@ typedef struct Type {
 
 } Type;
 
-static Type *create_type(AST *declaring_node, String name, Type_Kind kind) {
-  vector_push(&type_table, &(Type){
-                               .name = name,
-                               .kind = kind,
-                               .id = type_table.length,
-                           });
+#define TYPE_CHUNK_BITS 8
+#define TYPE_CHUNK_SIZE (1 << TYPE_CHUNK_BITS)
+#define TYPE_MAX_CHUNKS 4096
+
+// Types live in fixed size chunks that never move once allocated, so a Type * stays valid for the
+// whole compilation no matter how many types get created after it.
+// Appending is serialized by `lock`, reading a type by id never locks: a chunk is fully written before
+// `length` is published with a release store, and readers bounds check against an acquire load of it.
+// The name/function indices are only touched with `lock` held.
+typedef struct {
+  Type *_Atomic chunks[TYPE_MAX_CHUNKS];
+  atomic_size_t length;
+  pthread_mutex_t lock;
+} Type_Table;
+
+extern Type_Table type_table;
+
+static Type *get_type(size_t id) {
+  if (id >= atomic_load_explicit(&type_table.length, memory_order_acquire))
+    return nullptr;
+  Type *chunk = atomic_load_explicit(&type_table.chunks[id >> TYPE_CHUNK_BITS], memory_order_relaxed);
+  return &chunk[id & (TYPE_CHUNK_SIZE - 1)];
+}
 
-  Type *type = V_PTR_BACK(Type, type_table);
+// expects type_table.lock to be held.
+static Type *create_type_locked(AST *declaring_node, String name, Type_Kind kind) {
+  size_t id = atomic_load_explicit(&type_table.length, memory_order_relaxed);
+  size_t chunk_index = id >> TYPE_CHUNK_BITS;
+  if (chunk_index >= TYPE_MAX_CHUNKS) {
+    panic("Too many types");
+  }
+
+  Type *chunk = atomic_load_explicit(&type_table.chunks[chunk_index], memory_order_relaxed);
+  if (!chunk) {
+    chunk = calloc(TYPE_CHUNK_SIZE, sizeof(Type));
+    if (!chunk) {
+      panic("Failed to allocate memory for type table");
+    }
+    atomic_store_explicit(&type_table.chunks[chunk_index], chunk, memory_order_relaxed);
+  }
+
+  Type *type = &chunk[id & (TYPE_CHUNK_SIZE - 1)];
+  *type = (Type){
+      .name = name,
+      .kind = kind,
+      .id = id,
+  };
 
   if (kind == STRUCT)
     vector_init(&type->$struct.members, sizeof(Type_Member));
 
+  if (name.length) {
+    hash_index_insert(&type_name_index, hash_string(name), type->id);
+  }
+
+  atomic_store_explicit(&type_table.length, id + 1, memory_order_release);
   return type;
 }
 
-static int8_t get_member_index(Type *type, String member_name) {
-  if (type->kind != STRUCT)
-    return -1;
-  ForEach(Type_Member, member, type->$struct.members, {
-    if (Strings_compare(member.name, member_name)) {
-      return i;
-    }
-  });
-  return -1;
+static Type *create_type(AST *declaring_node, String name, Type_Kind kind) {
+  pthread_mutex_lock(&type_table.lock);
+  Type *type = create_type_locked(declaring_node, name, kind);
+  pthread_mutex_unlock(&type_table.lock);
+  return type;
+}
+
+static u64 function_type_hash(size_t return_type, Vector parameter_types, bool is_varargs) {
+  u64 hash = hash_bytes(parameter_types.data, parameter_types.length * sizeof(size_t));
+  hash ^= (return_type + 0x9e3779b97f4a7c15ull + (hash << 6) + (hash >> 2));
+  return hash ^ (u64)is_varargs;
 }
 
-// parameter_types is Vector<size_t>
+// Function types are hash consed, the same (return, parameters, varargs) always yields the same type id.
+// parameter_types is Vector<size_t>, and is owned by the type table afterwards.
 static Type *create_or_find_function_type(AST *declaring_node,
                                           size_t return_type,
                                           Vector parameter_types,
                                           bool is_varargs, bool *created) {
   *created = false;
 
-  ForEachPtr(Type, type, type_table, {
-    if (type->kind != FUNCTION)
-      continue;
-
+  pthread_mutex_lock(&type_table.lock);
+  u64 hash = function_type_hash(return_type, parameter_types, is_varargs);
+  size_t cursor = 0, id;
+  while ((id = hash_index_next(&function_type_index, hash, &cursor)) != HASH_INDEX_END) {
+    Type *type = get_type(id);
     typeof(type->$function) function = type->$function;
 
-    if (is_varargs != function.is_varargs)
-
+    if (is_varargs != function.is_varargs || function.$return != return_type ||
+        function.parameters.length != parameter_types.length)
       continue;
 
-    if (function.parameters.length != parameter_types.length)
-      continue;
-
-    bool match = true;
-    for (int i = 0; i < function.parameters.length; ++i) {
-      size_t a = ((size_t *)function.parameters.data)[i];
-      size_t b = ((size_t *)parameter_types.data)[i];
-      if (a != b) {
-        match = false;
-        break;
-      }
-    }
-
-    if (!match)
-      continue;
-
-    if (type->$function.$return == return_type)
+    if (memcmp(function.parameters.data, parameter_types.data, parameter_types.length * sizeof(size_t)) != 0)
       continue;
 
+    pthread_mutex_unlock(&type_table.lock);
+    vector_free(&parameter_types);
     return type;
-  });
+  }
 
   *created = true;
   // TODO: make a function type name?
-  Type *type = create_type(declaring_node, (String){}, FUNCTION);
+  Type *type = create_type_locked(declaring_node, (String){}, FUNCTION);
   type->$function.$return = return_type;
   type->$function.parameters = parameter_types;
   type->$function.is_varargs = is_varargs;
+  hash_index_insert(&function_type_index, hash, type->id);
+  pthread_mutex_unlock(&type_table.lock);
   return type;
 }
 
 static Type *find_type(String name) {
-  ForEachPtr(Type, type, type_table, {
+  size_t cursor = 0, id;
+  u64 hash = hash_string(name);
+  Type *found = nullptr;
+  pthread_mutex_lock(&type_table.lock);
+  while ((id = hash_index_next(&type_name_index, hash, &cursor)) != HASH_INDEX_END) {
+    Type *type = get_type(id);
     if (Strings_compare(type->name, name)) {
-      return type;
+      found = type;
+      break;
     }
-  });
-  return nullptr;
+  }
+  pthread_mutex_unlock(&type_table.lock);
+  return found;
 }
 
 static Type_Member *find_member(Type *type, String name) {
@@ -137,18 +192,76 @@ static Type_Member *find_member(Type *type, String name) {
   }) return nullptr;
 }
 
-static Type *get_type(size_t id) {
-  if (id > type_table.length)
-    return nullptr;
-  return V_PTR_AT(Type, type_table, id);
-}
-
 static void initialize_type_system() {
-  vector_init(&type_table, sizeof(Type));
+  atomic_store(&type_table.length, 0);
+  hash_index_free(&type_name_index);
+  hash_index_free(&function_type_index);
   create_type(nullptr, (String){.data = "void", .length = 4}, VOID);
   create_type(nullptr, (String){.data = "i32", .length = 3}, I32);
   create_type(nullptr, (String){.data = "f32", .length = 3}, F32);
   create_type(nullptr, (String){.data = "String", .length = 6}, STRING);
+  create_type(nullptr, (String){.data = "i8", .length = 2}, I8);
+  create_type(nullptr, (String){.data = "i16", .length = 3}, I16);
+  create_type(nullptr, (String){.data = "i64", .length = 3}, I64);
+  create_type(nullptr, (String){.data = "u8", .length = 2}, U8);
+  create_type(nullptr, (String){.data = "u16", .length = 3}, U16);
+  create_type(nullptr, (String){.data = "u32", .length = 3}, U32);
+  create_type(nullptr, (String){.data = "u64", .length = 3}, U64);
+}
+
+// the width of an integer type, 0 for anything else.
+static u32 type_integer_bits(size_t type) {
+  switch (type) {
+    case I8:
+    case U8:
+      return 8;
+    case I16:
+    case U16:
+      return 16;
+    case I32:
+    case U32:
+      return 32;
+    case I64:
+    case U64:
+      return 64;
+    default:
+      return 0;
+  }
+}
+
+static bool type_is_unsigned(size_t type) {
+  return type == U8 || type == U16 || type == U32 || type == U64;
+}
+
+// whether `value` is in range for the integer type.
+static bool type_integer_fits(size_t type, u64 value) {
+  u32 bits = type_integer_bits(type);
+  if (!type_is_unsigned(type)) bits--;
+  return bits >= 64 || value < ((u64)1 << bits);
+}
+
+// Splits a canonical type name like "Pair<Vec<i32>,f32>" into "Pair" and its top level arguments,
+// pushed onto `arguments` (Vector<String>) as views into `name`. Returns false for a name without arguments.
+static bool type_name_split(String name, String *base, Vector *arguments) {
+  int open = 0;
+  while (open < name.length && name.data[open] != '<') open++;
+  *base = (String){.data = name.data, .length = open};
+  if (open == name.length) {
+    return false;
+  }
+
+  int depth = 0, start = open + 1;
+  for (int i = start; i < name.length; ++i) {
+    char c = name.data[i];
+    if (c == '<') {
+      depth++;
+    } else if ((c == ',' && depth == 0) || (c == '>' && depth-- == 0)) {
+      String argument = {.data = name.data + start, .length = i - start};
+      vector_push(arguments, &argument);
+      start = i + 1;
+    }
+  }
+  return true;
 }
 
 static String type_to_string(Type *type) {
@@ -161,6 +274,14 @@ static String type_to_string(Type *type) {
       return (String){.data = "f32", .length = 3};
     case STRING:
       return (String){.data = "String", .length = 6};
+    case I8:
+    case I16:
+    case I64:
+    case U8:
+    case U16:
+    case U32:
+    case U64:
+      return type->name;
     case STRUCT:
       if (type->name.data && type->name.length > 0)
         return type->name;
@@ -1,69 +1,221 @@
 #include "typer.h"
 #include <string.h>
+#include <time.h>
 #include "core.h"
 #include "graph.h"
+#include "parallel.h"
 #include "parser.h"
+#include "query.h"
 #include "thir.h"
 #include "type.h"
 
-bool dep_node_dependencies_resolved(DepNode *node) {
-  for (int i = 0; i > node->length; ++i) {
-    DepNode *dep = node->dependencies[i];
-    switch (dep->state) {
-      case UNRESOLVED:
-      case RESOLVING:
-        return false;
-      case RESOLVED:
-        break;
-      case ERRORED:
-        printf("error %s\n", dep->error);
-        break;
+u32 thir_function_count = 0;
+
+#define UNINFERRED ((size_t)-1)
+
+// user declared types go through layout_of, so a struct is always complete before anything uses it.
+static size_t resolve_type_name(Query_Engine *engine, AST *scope, String name) {
+  // generic parameters of the instance being typed shadow everything else.
+  Instance *instance = query_current_instance(engine);
+  if (instance) {
+    Vector *parameters = ast_generic_parameters(instance->declaration);
+    for (size_t i = 0; i < parameters->length; ++i) {
+      if (Strings_compare(V_AT(String, (*parameters), i), name)) {
+        return instance->arguments[i];
+      }
     }
-    if (!dep_node_dependencies_resolved(dep)) {
-      return false;
+  }
+
+  String base;
+  Vector arguments;
+  vector_init(&arguments, sizeof(String));
+  if (type_name_split(name, &base, &arguments)) {
+    AST *generic = query_find_declaration(engine, scope, base);
+    if (!generic || generic->kind != AST_NODE_TYPE_DECLARATION || !ast_is_generic(generic)) {
+      parse_panicf(scope->location, "'%.*s' is not a generic type", base.length, base.data);
+    }
+    if (arguments.length != generic->declaration.generic_parameters.length) {
+      parse_panicf(scope->location, "'%.*s' takes %zu type arguments, got %zu", base.length, base.data,
+                   generic->declaration.generic_parameters.length, arguments.length);
+    }
+    size_t types[arguments.length];
+    for (size_t i = 0; i < arguments.length; ++i) {
+      types[i] = resolve_type_name(engine, scope, V_AT(String, arguments, i));
+    }
+    vector_free(&arguments);
+    return query_layout_of(engine, generic, query_instantiate(engine, generic, types))->type;
+  }
+
+  AST *declaration = query_find_declaration(engine, scope, name);
+  if (declaration && declaration->kind == AST_NODE_TYPE_DECLARATION) {
+    if (ast_is_generic(declaration)) {
+      parse_panicf(scope->location, "generic type '%.*s' needs type arguments", name.length, name.data);
     }
+    return query_layout_of(engine, declaration, nullptr)->type;
+  }
+  Type *type = find_type(name);
+  if (!type) {
+    parse_panicf(scope->location, "use of undeclared type '%.*s'", name.length, name.data);
+  }
+  return type->id;
+}
+
+// binds the generic parameters of `generic` that appear in a parameter's declared type `pattern`,
+// by matching it against the type of the argument passed for it.
+static void infer_type_arguments(AST *generic, String pattern, size_t actual, size_t *arguments,
+                                 Source_Location location) {
+  Vector *parameters = ast_generic_parameters(generic);
+  for (size_t i = 0; i < parameters->length; ++i) {
+    if (Strings_compare(V_AT(String, (*parameters), i), pattern)) {
+      if (arguments[i] != UNINFERRED && arguments[i] != actual) {
+        parse_panicf(location, "conflicting types for generic parameter '%.*s'", pattern.length, pattern.data);
+      }
+      arguments[i] = actual;
+      return;
+    }
+  }
+
+  // Pair<T> against Pair<i32>, argument by argument.
+  String pattern_base, actual_base;
+  Vector pattern_arguments, actual_arguments;
+  vector_init(&pattern_arguments, sizeof(String));
+  vector_init(&actual_arguments, sizeof(String));
+  if (type_name_split(pattern, &pattern_base, &pattern_arguments) &&
+      type_name_split(type_to_string(get_type(actual)), &actual_base, &actual_arguments) &&
+      Strings_compare(pattern_base, actual_base) && pattern_arguments.length == actual_arguments.length) {
+    for (size_t i = 0; i < pattern_arguments.length; ++i) {
+      Type *type = find_type(V_AT(String, actual_arguments, i));
+      if (type) {
+        infer_type_arguments(generic, V_AT(String, pattern_arguments, i), type->id, arguments, location);
+      }
+    }
+  }
+  vector_free(&pattern_arguments);
+  vector_free(&actual_arguments);
+}
+
+// what a suffix makes a literal, indexed by Number_Suffix.
+static const Type_Kind number_suffix_types[] = {VOID, I8, I16, I32, I64, U8, U16, U32, U64};
+
+// a literal without a suffix, or arithmetic on only those, takes the type its use expects.
+static bool is_untyped_literal(AST *node) {
+  switch (node->kind) {
+    case AST_NODE_NUMBER:
+      return node->number.suffix == NUMBER_SUFFIX_NONE;
+    case AST_NODE_BINARY_EXPRESSION:
+      return node->binary.operator != TOKEN_ASSIGN && is_untyped_literal(node->binary.left) &&
+             is_untyped_literal(node->binary.right);
+    default:
+      return false;
+  }
+}
+
+static void retype_literal(THIR *thir, size_t type) {
+  if (thir->kind == THIR_BINARY_EXPRESSION) {
+    retype_literal(thir->binary.left, type);
+    retype_literal(thir->binary.right, type);
+  } else if (!type_integer_fits(type, thir->number)) {
+    parse_panicf(thir->location, "integer literal %llu doesn't fit in '%s'", (unsigned long long)thir->number,
+                 type_to_string(get_type(type)).data);
+  }
+  thir->type = type;
+}
+
+// gives `thir`, typed from `node`, the integer type `expected` if it's an untyped literal.
+static void coerce_literal(AST *node, THIR *thir, size_t expected) {
+  if (thir->type != expected && type_integer_bits(expected) && is_untyped_literal(node)) {
+    retype_literal(thir, expected);
+  }
+}
+
+// there are no implicit conversions, an integer of one width where another is expected is an error.
+static void expect_type(THIR *thir, size_t expected, const char *where) {
+  if (thir->type != expected) {
+    String actual_name = type_to_string(get_type(thir->type));
+    String expected_name = type_to_string(get_type(expected));
+    parse_panicf(thir->location, "mismatched types in %s, got '%.*s' where '%.*s' is expected", where,
+                 (int)actual_name.length, actual_name.data, (int)expected_name.length, expected_name.data);
   }
-  return true;
 }
 
-THIR *generate_thir_from_ast(AST *node, Vector *thir_symbols) {
+// replaces an expression with the THIR_NUMBER it evaluates to at compile time.
+static THIR *const_eval_fold(Query_Engine *engine, THIR *expression) {
+  THIR *thir = THIR_ALLOC(THIR_NUMBER, expression->location);
+  thir->type = expression->type;
+  thir->number = const_eval_expression(engine, expression);
+  return thir;
+}
+
+// a function or type declaration referenced by name, as its signature or layout.
+static THIR *resolve_declaration(Query_Engine *engine, AST *declaration, Source_Location location) {
+  if (ast_is_generic(declaration)) {
+    parse_panic(location, "generics can only be referred to with their type arguments");
+  }
+  if (declaration->kind == AST_NODE_FUNCTION_DECLARATION) {
+    return query_signature_of(engine, declaration, nullptr);
+  }
+  return query_layout_of(engine, declaration, nullptr);
+}
+
+THIR *generate_thir_from_ast(AST *node, Query_Engine *engine) {
   if (!node) {
     panic("Null node in 'generate_thir_from_ast'");
   }
   switch (node->kind) {
     case AST_NODE_IDENTIFIER: {
       THIR *thir = THIR_ALLOC(THIR_IDENTIFIER, node->location);
-      THIRSymbol *symbol = find_thir_symbol(thir_symbols, node->identifier);
-      thir->identifier = (typeof(thir->identifier)){.name = node->identifier, .resolved = symbol->thir};
-      thir->type = symbol->thir->type;
+      THIRSymbol *symbol = find_thir_symbol(&query_worker(engine)->locals, node->identifier);
+      AST *declaration;
+      if (symbol) {
+        thir->identifier.resolved = symbol->thir;
+      } else if ((declaration = query_find_declaration(engine, node, node->identifier))) {
+        thir->identifier.resolved = resolve_declaration(engine, declaration, node->location);
+      } else {
+        parse_panicf(node->location, "use of undeclared identifier '%s'", node->identifier.data);
+      }
+      thir->type = thir->identifier.resolved->type;
       return thir;
     } break;
     case AST_NODE_NUMBER: {
       THIR *thir = THIR_ALLOC(THIR_NUMBER, node->location);
-      thir->number = node->number;
-      thir->type = I32;
+      thir->number = node->number.value;
+      if (node->number.suffix != NUMBER_SUFFIX_NONE) {
+        thir->type = number_suffix_types[node->number.suffix];
+        if (!type_integer_fits(thir->type, node->number.value)) {
+          parse_panicf(node->location, "integer literal %llu doesn't fit in '%s'",
+                       (unsigned long long)node->number.value, number_suffix_names[node->number.suffix]);
+        }
+      } else {
+        // the smallest of i32, i64 & u64 that holds it, until something expects another type.
+        thir->type = type_integer_fits(I32, node->number.value)   ? I32
+                     : type_integer_fits(I64, node->number.value) ? I64
+                                                                  : U64;
+      }
       return thir;
     } break;
     case AST_NODE_STRING: {
       THIR *thir = THIR_ALLOC(THIR_STRING, node->location);
-      thir->string = node->string;
+      thir->string.id = intern_string_literal(node->string, &thir->string.value);
       thir->type = STRING;
       return thir;
     } break;
     case AST_NODE_DOT_EXPRESSION: {
-      THIR *base = generate_thir_from_ast(node->dot.left, thir_symbols);
+      THIR *base = generate_thir_from_ast(node->dot.left, engine);
       THIR *thir = THIR_ALLOC(THIR_MEMBER_ACCESS, node->location);
       thir->member_access.base = base;
-      thir->member_access.member = node->dot.member_name;
 
       Type *base_type = get_type(base->type);
 
+      // resolve the member once here, the backend only ever sees the index.
       thir->type = -1;
-      for (int i = 0; i < base_type->$struct.members.length; ++i) {
-        Type_Member member = V_AT(Type_Member, base_type->$struct.members, i);
-        if (Strings_compare(member.name, node->dot.member_name)) {
-          thir->type = member.type;
-          break;
+      if (base_type->kind == STRUCT) {
+        for (int i = 0; i < base_type->$struct.members.length; ++i) {
+          Type_Member member = V_AT(Type_Member, base_type->$struct.members, i);
+          if (Strings_compare(member.name, node->dot.member_name)) {
+            thir->type = member.type;
+            thir->member_access.index = i;
+            break;
+          }
         }
       }
 
@@ -75,36 +227,80 @@ THIR *generate_thir_from_ast(AST *node, Vector *thir_symbols) {
       return thir;
     } break;
     case AST_NODE_FUNCTION_CALL: {
-      THIRSymbol *symbol = find_thir_symbol(thir_symbols, node->call.name);
-      if (!symbol) {
+      // locals can't be called, so this only ever needs the callee's signature, never its body.
+      AST *declaration = query_find_declaration(engine, node, node->call.name);
+      if (!declaration || declaration->kind != AST_NODE_FUNCTION_DECLARATION) {
         parse_panicf(node->location, "use of undeclared function '%s'", node->call.name.data);
       }
 
-      THIR *function = symbol->thir;
       THIR *thir = THIR_ALLOC(THIR_CALL, node->location);
+      thir->call.arguments = thir_list_alloc(node->call.arguments.length);
       for (int i = 0; i < node->call.arguments.length; ++i) {
         AST *argument = V_AT(AST *, node->call.arguments, i);
-        THIR *thir_arg = generate_thir_from_ast(argument, thir_symbols);
-        thir_list_push(&thir->call.arguments, thir_arg);
+        thir->call.arguments.nodes[i] = generate_thir_from_ast(argument, engine);
+      }
+
+      // generic functions are instantiated for the argument types they're called with.
+      Instance *instance = nullptr;
+      if (ast_is_generic(declaration)) {
+        Vector *parameters = &declaration->function.generic_parameters;
+        size_t types[parameters->length];
+        for (size_t i = 0; i < parameters->length; ++i) types[i] = UNINFERRED;
+
+        for (u32 i = 0; i < thir->call.arguments.length && i < declaration->function.parameters.length; ++i) {
+          AST_Parameter *parameter = V_PTR_AT(AST_Parameter, declaration->function.parameters, i);
+          if (parameter->is_vararg) break;
+          infer_type_arguments(declaration, parameter->type, thir->call.arguments.nodes[i]->type, types,
+                               node->location);
+        }
+        for (size_t i = 0; i < parameters->length; ++i) {
+          if (types[i] == UNINFERRED) {
+            String name = V_AT(String, (*parameters), i);
+            parse_panicf(node->location, "can't infer generic parameter '%.*s' of '%s' from the arguments",
+                         name.length, name.data, node->call.name.data);
+          }
+        }
+        instance = query_instantiate(engine, declaration, types);
       }
+
+      THIR *function = query_signature_of(engine, declaration, instance);
       thir->call.function = function;
-      Type *fn_type = get_type(symbol->thir->type);
+      Type *fn_type = get_type(function->type);
       thir->type = fn_type->$function.$return;
+      for (u32 i = 0; i < thir->call.arguments.length && i < fn_type->$function.parameters.length; ++i) {
+        size_t parameter_type = V_AT(size_t, fn_type->$function.parameters, i);
+        coerce_literal(V_AT(AST *, node->call.arguments, i), thir->call.arguments.nodes[i], parameter_type);
+        expect_type(thir->call.arguments.nodes[i], parameter_type, "call argument");
+      }
+
+      // a @const function called with constant arguments is computed right here, unless it's
+      // calling itself, its body isn't done yet.
+      Query *body = query_find(engine, QUERY_BODY_THIR, declaration, instance);
+      if (function->function.is_const && const_eval_is_constant(thir) && !query_is_running_here(engine, body)) {
+        return const_eval_fold(engine, thir);
+      }
 
       return thir;
     } break;
     case AST_NODE_BLOCK: {
       THIR *thir = THIR_ALLOC(THIR_BLOCK, node->location);
       thir->type = VOID;
-      thir->statements = (THIRList){0};
+      thir->statements = thir_list_alloc(node->statements.length);
+      thir_symbols_push_scope(&query_worker(engine)->locals);
       for (int i = 0; i < node->statements.length; ++i) {
-        thir_list_push(&thir->statements, generate_thir_from_ast(node->statements.data[i], thir_symbols));
+        thir->statements.nodes[i] = generate_thir_from_ast(node->statements.data[i], engine);
       }
+      thir_symbols_pop_scope(&query_worker(engine)->locals);
       return thir;
     } break;
     case AST_NODE_BINARY_EXPRESSION: {
-      THIR *left = generate_thir_from_ast(node->binary.left, thir_symbols);
-      THIR *right = generate_thir_from_ast(node->binary.right, thir_symbols);
+      THIR *left = generate_thir_from_ast(node->binary.left, engine);
+      THIR *right = generate_thir_from_ast(node->binary.right, engine);
+
+      // an untyped side takes the other side's type, 'x + 1' is as wide as x.
+      coerce_literal(node->binary.right, right, left->type);
+      coerce_literal(node->binary.left, left, right->type);
+      expect_type(right, left->type, node->binary.operator == TOKEN_ASSIGN ? "assignment" : "binary expression");
 
       THIR *thir = THIR_ALLOC(THIR_BINARY_EXPRESSION, node->location);
       thir->binary.operator= node->binary.operator;
@@ -116,109 +312,57 @@ THIR *generate_thir_from_ast(AST *node, Vector *thir_symbols) {
     case AST_NODE_RETURN: {
       THIR *thir = THIR_ALLOC(THIR_RETURN, node->location);
       if (node->return_expression) {
-        thir->return_expression = generate_thir_from_ast(node->return_expression, thir_symbols);
+        thir->return_expression = generate_thir_from_ast(node->return_expression, engine);
+        THIR *function = query_worker(engine)->function;
+        if (function) {
+          size_t return_type = get_type(function->type)->$function.$return;
+          coerce_literal(node->return_expression, thir->return_expression, return_type);
+          expect_type(thir->return_expression, return_type, "return");
+        }
       }
       thir->type = VOID;
       return thir;
     } break;
-    case AST_NODE_FUNCTION_DECLARATION: {
-      THIR *thir = THIR_ALLOC(THIR_FUNCTION, node->location);
-      thir->function.llvm_function = NULL;
-
-      if (node->function.block) {
-        thir->function.block = generate_thir_from_ast(node->function.block, thir_symbols);
+    // declarations nested in a block are queried like top level ones,
+    // generics only through their instances, so where they're declared is a no-op.
+    case AST_NODE_FUNCTION_DECLARATION:
+    case AST_NODE_TYPE_DECLARATION:
+      if (ast_is_generic(node)) {
+        THIR *thir = THIR_ALLOC(THIR_BLOCK, node->location);
+        thir->type = VOID;
+        return thir;
       }
-
-      Vector parameter_types;
-      bool is_varargs = false;
-      vector_init(&parameter_types, sizeof(size_t));
-      vector_init(&thir->function.parameters, sizeof(THIRParameter));
-
-      for (int i = 0; i < node->function.parameters.length; ++i) {
-        AST_Parameter *parameter = V_PTR_AT(AST_Parameter, node->function.parameters, i);
-
-        size_t type;
-        Type *type_ptr;
-        if (!parameter->is_vararg && (type_ptr = find_type(parameter->type))) {
-          type = type_ptr->id;
-        } else {
-          type = VOID;
-        }
-
-        if (parameter->is_vararg) {
-          is_varargs = true;
-        } else {
-          vector_push(&parameter_types, &type);
-        }
-
-        vector_push(&thir->function.parameters, &(THIRParameter){
-                                                    .type = type,
-                                                    .name = parameter->name,
-                                                    .is_vararg = parameter->is_vararg,
-                                                });
-      }
-
-      Type *return_type = find_type(node->function.return_type);
-
-      bool new;
-      thir->type = create_or_find_function_type(node, return_type->id, parameter_types, is_varargs, &new)->id;
-
-      thir->function.is_entry = node->function.is_entry;
-      thir->function.is_extern = node->function.is_extern;
-      thir->function.name = node->function.name;
-
-      vector_push(thir_symbols, &(THIRSymbol){
-                                    .thir = thir,
-                                    .name = node->function.name,
-                                });
-
-      return thir;
-    } break;
-    case AST_NODE_TYPE_DECLARATION: {
-      THIR *thir = THIR_ALLOC(THIR_TYPE_DECLARATION, node->location);
-      Type *new_type = create_type(node, node->declaration.name, STRUCT);
-      vector_init(&thir->type_declaration.members, sizeof(THIRMember));
-      thir->type_declaration.name = node->declaration.name;
-      for (int i = 0; i < node->declaration.members.length; ++i) {
-        AST_Type_Member member = V_AT(AST_Type_Member, node->declaration.members, i);
-        THIRMember thir_member = {.type = find_type(member.type)->id, .name = member.name};
-
-        vector_push(&new_type->$struct.members, &(Type_Member){
-                                                    .name = thir_member.name,
-                                                    .type = thir_member.type,
-                                                });
+      if (node->kind == AST_NODE_TYPE_DECLARATION) {
+        return query_layout_of(engine, node, nullptr);
       }
-
-      vector_push(thir_symbols, &(THIRSymbol){
-                                    .thir = thir,
-                                    .name = node->declaration.name,
-                                });
-      thir->type = new_type->id;
-      return thir;
-    } break;
+      // the body is typed in a round of its own, once, however many instances of an enclosing generic get here.
+      return query_signature_of(engine, node, nullptr);
     case AST_NODE_VARIABLE_DECLARATION: {
       THIR *thir = THIR_ALLOC(THIR_VARIABLE_DECLARATION, node->location);
 
-      size_t expected_type = find_type(node->variable.type)->id;
+      size_t expected_type = resolve_type_name(engine, node, node->variable.type);
       thir->variable.name = node->variable.name;
 
       if (node->variable.value) {
-        thir->variable.value = generate_thir_from_ast(node->variable.value, thir_symbols);
+        thir->variable.value = generate_thir_from_ast(node->variable.value, engine);
+        coerce_literal(node->variable.value, thir->variable.value, expected_type);
 
         size_t expr_type = thir->variable.value->type;
         if (expected_type != expr_type) {
           parse_panic(node->location, "invalid type in variable declaration");
         }
 
+        if (node->variable.is_const) {
+          thir->variable.is_const = true;
+          thir->variable.value = const_eval_fold(engine, thir->variable.value);
+        }
+
       } else {
         thir->variable.value = NULL;
       }
 
       thir->type = expected_type;
-      vector_push(thir_symbols, &(THIRSymbol){
-                                    .name = node->variable.name,
-                                    .thir = thir,
-                                });
+      insert_thir_symbol(&query_worker(engine)->locals, node->variable.name, thir);
       return thir;
     } break;
     case AST_NODE_PROGRAM:
@@ -227,75 +371,305 @@ THIR *generate_thir_from_ast(AST *node, Vector *thir_symbols) {
   return nullptr;
 }
 
-void generate_thir_for_node(DepNode *node, Vector *thir_symbols, THIR *program) {
-  if (node->state == RESOLVED) return;
+// signatures & layouts hold the engine lock while they run, they're shared by every body and cheap next to them.
+THIR *query_signature_of(Query_Engine *engine, AST *node, Instance *instance) {
+  bool cached;
+  query_lock(engine);
+  Query *query = query_begin(engine, QUERY_SIGNATURE_OF, node, instance, &cached);
+  if (cached) {
+    query_unlock(engine);
+    return query->result;
+  }
 
-  if (node->state == RESOLVING) {
-    parse_panic(node->ast_node->location, "cyclic dependency detected");
-    return;
+  THIR *thir = THIR_ALLOC(THIR_FUNCTION, node->location);
+  thir->function.id = thir_function_count++;
+
+  Vector parameter_types;
+  bool is_varargs = false;
+  vector_init(&parameter_types, sizeof(size_t));
+  thir->function.parameters = thir_list_alloc(node->function.parameters.length);
+
+  for (int i = 0; i < node->function.parameters.length; ++i) {
+    AST_Parameter *parameter = V_PTR_AT(AST_Parameter, node->function.parameters, i);
+
+    size_t type = VOID;
+    if (parameter->is_vararg) {
+      is_varargs = true;
+    } else {
+      type = resolve_type_name(engine, node, parameter->type);
+      vector_push(&parameter_types, &type);
+    }
+
+    THIR *thir_parameter = THIR_ALLOC(THIR_PARAMETER, node->location);
+    thir_parameter->type = type;
+    thir_parameter->parameter.name = parameter->name;
+    thir_parameter->parameter.slot = i;
+    thir_parameter->parameter.is_vararg = parameter->is_vararg;
+    thir->function.parameters.nodes[i] = thir_parameter;
+  }
+
+  size_t return_type = resolve_type_name(engine, node, node->function.return_type);
+  // it's called like C's main, --run calls it as one of these two.
+  if (node->function.is_entry && return_type != VOID && return_type != I32) {
+    String name = type_to_string(get_type(return_type));
+    parse_panicf(node->location, "@entry function '%s' must return i32 or nothing, not '%.*s'",
+                 node->function.name.data, (int)name.length, name.data);
   }
 
-  node->state = RESOLVING;
+  bool new;
+  thir->type = create_or_find_function_type(node, return_type, parameter_types, is_varargs, &new)->id;
+
+  thir->function.is_entry = node->function.is_entry;
+  thir->function.is_extern = node->function.is_extern;
+  thir->function.is_export = node->function.is_export;
+  thir->function.is_const = node->function.is_const;
+  thir->function.is_inline = node->function.is_inline;
+  thir->function.is_noinline = node->function.is_noinline;
+  thir->function.is_optnone = node->function.is_optnone;
+  thir->function.is_minsize = node->function.is_minsize;
+  thir->function.is_cold = node->function.is_cold;
+  thir->function.name = instance ? instance->name : node->function.name;
+  thir->function.declaration = node;
+  thir->function.instance = instance;
+
+  query_end(engine, query, thir);
+  query_unlock(engine);
+  return thir;
+}
 
-  for (size_t i = 0; i < node->length; ++i) {
-    generate_thir_for_node(node->dependencies[i], thir_symbols, program);
+THIR *query_body_thir(Query_Engine *engine, AST *node, Instance *instance) {
+  // taken before the body query starts, so the body depends on the signature and not the other way around.
+  THIR *thir = query_signature_of(engine, node, instance);
+  if (!node->function.block) {
+    return thir;
   }
 
-  THIR *thir = generate_thir_from_ast(node->ast_node, thir_symbols);
-  thir_list_push(&program->statements, thir);
+  bool cached;
+  query_lock(engine);
+  Query *query = query_begin(engine, QUERY_BODY_THIR, node, instance, &cached);
+  // the body itself only touches this thread's worker, so other bodies can be typed meanwhile.
+  query_unlock(engine);
+  if (cached) return query->result;
+
+  // a top level function reached from inside another body (through compile time evaluation)
+  // mustn't see that body's locals.
+  THIRSymbolTable *locals = &query_worker(engine)->locals;
+  THIRSymbolTable outer = *locals;
+  bool isolated = outer.scopes.length && node->parent == engine->program;
+  if (isolated) {
+    thir_symbol_table_init(locals);
+  }
 
-  node->state = RESOLVED;
+  thir_symbols_push_scope(locals);
+  for (u32 i = 0; i < thir->function.parameters.length; ++i) {
+    THIR *parameter = thir->function.parameters.nodes[i];
+    if (!parameter->parameter.is_vararg && parameter->parameter.name.length) {
+      insert_thir_symbol(locals, parameter->parameter.name, parameter);
+    }
+  }
+  Query_Worker *worker = query_worker(engine);
+  THIR *function = worker->function;
+  worker->function = thir;
+  thir->function.block = generate_thir_from_ast(node->function.block, engine);
+  worker->function = function;
+  thir_symbols_pop_scope(locals);
+
+  if (isolated) {
+    thir_symbol_table_free(locals);
+    *locals = outer;
+  }
+
+  query_lock(engine);
+  query_end(engine, query, thir);
+  query_unlock(engine);
+  return thir;
 }
 
-THIR *generate_thir(DepGraph *graph, DepNodeRegistry *registry, Vector *thir_symbols) {
-  THIR *program = THIR_ALLOC(THIR_PROGRAM, (Source_Location){0});
-  size_t n = graph->length;
-  size_t *in_degree = calloc(n, sizeof(size_t));
+THIR *query_layout_of(Query_Engine *engine, AST *node, Instance *instance) {
+  bool cached;
+  query_lock(engine);
+  Query *query = query_begin(engine, QUERY_LAYOUT_OF, node, instance, &cached);
+  if (cached) {
+    query_unlock(engine);
+    return query->result;
+  }
+
+  THIR *thir = THIR_ALLOC(THIR_TYPE_DECLARATION, node->location);
+  thir->type_declaration.name = instance ? instance->name : node->declaration.name;
+
+  // member types first, a struct containing itself is caught as a cycle instead of finding a half built type.
+  Vector members;
+  vector_init(&members, sizeof(Type_Member));
+  for (int i = 0; i < node->declaration.members.length; ++i) {
+    AST_Type_Member member = V_AT(AST_Type_Member, node->declaration.members, i);
+    vector_push(&members, &(Type_Member){
+                              .name = member.name,
+                              .type = resolve_type_name(engine, node, member.type),
+                          });
+  }
 
-  size_t processed = 0;
-  size_t qlen = 0;
-  DepNode **queue = malloc(n * sizeof(DepNode *));
+  Type *new_type = create_type(node, thir->type_declaration.name, STRUCT);
+  ForEach(Type_Member, member, members, { vector_push(&new_type->$struct.members, &member); });
+  vector_free(&members);
 
-  // Count in-degrees (num deps per branch)
-  for (size_t i = 0; i < n; ++i) {
-    in_degree[i] = graph->nodes[i]->length;
+  thir->type = new_type->id;
+  query_end(engine, query, thir);
+  query_unlock(engine);
+  return thir;
+}
+
+size_t query_type_of(Query_Engine *engine, AST *node, Instance *instance) {
+  if (node->kind == AST_NODE_FUNCTION_DECLARATION) {
+    return query_signature_of(engine, node, instance)->type;
   }
+  return query_layout_of(engine, node, instance)->type;
+}
 
-  // Queue initial nodes, those with 0 deps.
-  for (size_t i = 0; i < n; ++i) {
-    if (in_degree[i] == 0) {
-      queue[qlen++] = graph->nodes[i];
+static bool is_typing_root(AST *node) {
+  return node->kind == AST_NODE_FUNCTION_DECLARATION && (node->function.is_entry || node->function.is_export);
+}
+
+static THIR *thir_program_from_queries(Query_Engine *engine) {
+  THIR *program = THIR_ALLOC(THIR_PROGRAM, (Source_Location){0});
+  program->statements = thir_list_alloc(engine->completed.length);
+  memcpy(program->statements.nodes, engine->completed.data, engine->completed.length * sizeof(THIR *));
+  return program;
+}
+
+typedef struct {
+  Query_Engine *engine;
+  Vector bodies; // Vector<Query *>, the signatures whose bodies this round types.
+} Body_Phase;
+
+static void type_body(void *user, size_t worker, size_t index) {
+  Body_Phase *phase = user;
+  Query *signature = V_AT(Query *, phase->bodies, index);
+  query_enter_worker(query_get_worker(phase->engine, worker));
+  query_body_thir(phase->engine, signature->declaration, signature->instance);
+}
+
+static int compare_declaration_thir(const void *a, const void *b) {
+  THIR *left = *(THIR **)a, *right = *(THIR **)b;
+  if (left->location.line != right->location.line) return left->location.line - right->location.line;
+  if (left->location.column != right->location.column) return left->location.column - right->location.column;
+  String left_name = left->kind == THIR_FUNCTION ? left->function.name : left->type_declaration.name;
+  String right_name = right->kind == THIR_FUNCTION ? right->function.name : right->type_declaration.name;
+  size_t length = left_name.length < right_name.length ? left_name.length : right_name.length;
+  int order = memcmp(left_name.data, right_name.data, length);
+  return order ? order : (int)left_name.length - (int)right_name.length;
+}
+
+// A body only asks for its callees' signatures, so once the signatures are known the bodies of everything
+// reached are typed in parallel. They can reach new signatures (instances, nested functions) in turn, which
+// have their bodies typed in the next round, until a round finds nothing new.
+static void type_reached_bodies(Query_Engine *engine) {
+  Body_Phase phase = {.engine = engine};
+  vector_init(&phase.bodies, sizeof(Query *));
+
+  for (size_t start = 0; start < engine->queries.length;) {
+    size_t end = engine->queries.length;
+    size_t completed = engine->completed.length;
+    phase.bodies.length = 0;
+    for (size_t i = start; i < end; ++i) {
+      Query *query = V_AT(Query *, engine->queries, i);
+      if (query->kind != QUERY_SIGNATURE_OF || !query->declaration->function.block) continue;
+      if (query->declaration->function.is_const) {
+        // compile time evaluation can ask for these from any body, typing them up front means
+        // no worker ever waits on a body another one is in the middle of.
+        query_body_thir(engine, query->declaration, query->instance);
+      } else {
+        vector_push(&phase.bodies, &query);
+      }
     }
+    start = end;
+
+    size_t workers = parallel_worker_count(phase.bodies.length);
+    for (size_t i = 0; i < workers; ++i) {
+      query_get_worker(engine, i);
+    }
+    parallel_for_workers(phase.bodies.length, &phase, type_body);
+    query_enter_worker(nullptr);
+
+    // workers finish in whatever order, so what they added to the program is put back in source order.
+    qsort((THIR **)engine->completed.data + completed, engine->completed.length - completed, sizeof(THIR *),
+          compare_declaration_thir);
   }
+  vector_free(&phase.bodies);
+
+  // ids were handed out in whatever order the workers reached the signatures, renumbered in program order
+  // they're the same on every run, and so are the symbols the backend builds from them.
+  u32 id = 0;
+  ForEach(THIR *, declaration, engine->completed, {
+    if (declaration->kind == THIR_FUNCTION) declaration->function.id = id++;
+  });
+  thir_function_count = id;
+}
 
-  while (processed < qlen) {
-    DepNode *node = queue[processed++];
-    generate_thir_for_node(node, thir_symbols, program);
+static bool is_instantiated(Query_Engine *engine, AST *generic) {
+  ForEach(Instance *, instance, engine->instances, {
+    if (instance->declaration == generic) return true;
+  });
+  return false;
+}
 
-    // For each node that depends on this node, decrement in-degree
-    for (size_t i = 0; i < n; ++i) {
-      DepNode *other = graph->nodes[i];
-      for (size_t j = 0; j < other->length; ++j) {
-        if (other->dependencies[j] == node) {
-          if (--in_degree[i] == 0) {
-            queue[qlen++] = other;
-          }
-        }
-      }
+// declarations nothing reached, generics count as reached through any of their instances.
+static bool is_skipped(Query_Engine *engine, AST *node) {
+  if (node->kind != AST_NODE_FUNCTION_DECLARATION && node->kind != AST_NODE_TYPE_DECLARATION) {
+    return false;
+  }
+  if (ast_is_generic(node)) {
+    return !is_instantiated(engine, node);
+  }
+  Query_Kind kind = node->kind == AST_NODE_FUNCTION_DECLARATION ? QUERY_SIGNATURE_OF : QUERY_LAYOUT_OF;
+  return !query_find(engine, kind, node, nullptr);
+}
+
+THIR *generate_thir_on_demand(Query_Engine *engine) {
+  AST *ast = engine->program;
+  for (size_t i = 0; i < ast->statements.length; ++i) {
+    if (is_typing_root(ast->statements.data[i])) {
+      query_signature_of(engine, ast->statements.data[i], nullptr);
     }
   }
+  type_reached_bodies(engine);
 
-  free(in_degree);
-  free(queue);
+  size_t skipped = 0;
+  for (size_t i = 0; i < ast->statements.length; ++i) {
+    if (is_skipped(engine, ast->statements.data[i])) skipped++;
+  }
 
-  // Ensure all nodes are processed (handles disconnected components/cycles)
-  for (size_t i = 0; i < n; ++i) {
-    if (graph->nodes[i]->state != RESOLVED) {
-      generate_thir_for_node(graph->nodes[i], thir_symbols, program);
+  if (skipped) {
+    printf("skipped typing %zu unreferenced declaration%s:\n", skipped, skipped == 1 ? "" : "s");
+    size_t listed = 0;
+    for (size_t i = 0; i < ast->statements.length && listed < 32; ++i) {
+      AST *statement = ast->statements.data[i];
+      if (!is_skipped(engine, statement)) continue;
+      String name =
+          statement->kind == AST_NODE_FUNCTION_DECLARATION ? statement->function.name : statement->declaration.name;
+      printf("  %.*s\n", (int)name.length, name.data);
+      listed++;
+    }
+    if (skipped > listed) {
+      printf("  ... and %zu more\n", skipped - listed);
     }
   }
 
-  return program;
+  return thir_program_from_queries(engine);
+}
+
+THIR *generate_thir(Query_Engine *engine) {
+  AST *ast = engine->program;
+  // signatures & layouts first, every query pulls in what it depends on, so the order here doesn't matter.
+  // generics are only typed as the instances something uses.
+  for (size_t i = 0; i < ast->statements.length; ++i) {
+    AST *statement = ast->statements.data[i];
+    if (!ast_is_generic(statement) &&
+        (statement->kind == AST_NODE_FUNCTION_DECLARATION || statement->kind == AST_NODE_TYPE_DECLARATION)) {
+      query_type_of(engine, statement, nullptr);
+    }
+  }
+  type_reached_bodies(engine);
+  return thir_program_from_queries(engine);
 }
 
 void pretty_print_thir(THIR *thir, int indent) {
@@ -334,34 +708,52 @@ void pretty_print_thir(THIR *thir, int indent) {
       }
       break;
 
-    case THIR_MEMBER_ACCESS:
+    case THIR_MEMBER_ACCESS: {
       print_indent(indent + 1);
       printf("<base>\n");
       pretty_print_thir(thir->member_access.base, indent + 2);
       print_indent(indent + 1);
-      printf("<member> ");
-      print_string(thir->member_access.member);
+      Type *base_type = get_type(thir->member_access.base->type);
+      printf("<member> %u :: ", thir->member_access.index);
+      print_string(V_PTR_AT(Type_Member, base_type->$struct.members, thir->member_access.index)->name);
       printf("\n");
-      break;
+    } break;
 
-    case THIR_IDENTIFIER:
+    case THIR_IDENTIFIER: {
+      THIR *resolved = thir->identifier.resolved;
       print_indent(indent + 1);
-      printf("Identifier: ");
-      print_string(thir->identifier.name);
+      switch (resolved->kind) {
+        case THIR_PARAMETER:
+          printf("Parameter: %u :: ", resolved->parameter.slot);
+          print_string(resolved->parameter.name);
+          break;
+        case THIR_FUNCTION:
+          printf("Function: ");
+          print_string(resolved->function.name);
+          break;
+        default:
+          printf("Identifier: ");
+          print_string(resolved->variable.name);
+          break;
+      }
       printf("\n");
+    } break;
+
+    case THIR_PARAMETER:
+      print_indent(indent + 1);
+      print_string(thir->parameter.name);
+      printf(" : %u%s\n", thir->parameter.slot, thir->parameter.is_vararg ? " (vararg)" : "");
       break;
 
     case THIR_NUMBER:
       print_indent(indent + 1);
-      printf("Number: ");
-      print_string(thir->number);
-      printf("\n");
+      printf("Number: %lld\n", thir->number);
       break;
 
     case THIR_STRING:
       print_indent(indent + 1);
       printf("String: ");
-      print_string(thir->string);
+      print_string(thir->string.value);
       printf("\n");
       break;
 
@@ -375,14 +767,15 @@ void pretty_print_thir(THIR *thir, int indent) {
       print_indent(indent + 1);
       printf("Function: ");
       print_string(thir->function.name);
-      printf("%s%s\n", thir->function.is_extern ? " [extern]" : "", thir->function.is_entry ? " [entry]" : "");
+      printf("%s%s%s%s%s%s%s%s%s\n", thir->function.is_extern ? " [extern]" : "",
+             thir->function.is_entry ? " [entry]" : "", thir->function.is_export ? " [export]" : "",
+             thir->function.is_const ? " [const]" : "", thir->function.is_inline ? " [inline]" : "",
+             thir->function.is_noinline ? " [noinline]" : "", thir->function.is_optnone ? " [optnone]" : "",
+             thir->function.is_minsize ? " [minsize]" : "", thir->function.is_cold ? " [cold]" : "");
       print_indent(indent + 1);
       printf("<params>\n");
       for (size_t i = 0; i < thir->function.parameters.length; ++i) {
-        THIRParameter *param = V_PTR_AT(THIRParameter, thir->function.parameters, i);
-        print_indent(indent + 2);
-        print_string(param->name);
-        printf(" : %zu%s\n", param->type, param->is_vararg ? " (vararg)" : "");
+        pretty_print_thir(thir->function.parameters.nodes[i], indent + 2);
       }
       print_indent(indent + 1);
       printf("<block>\n");
@@ -394,19 +787,18 @@ void pretty_print_thir(THIR *thir, int indent) {
       printf("Type: ");
       print_string(thir->type_declaration.name);
       printf("\n");
-      for (size_t i = 0; i < thir->type_declaration.members.length; ++i) {
-        THIRMember *member = V_PTR_AT(THIRMember, thir->type_declaration.members, i);
+      ForEachPtr(Type_Member, member, get_type(thir->type)->$struct.members, {
         print_indent(indent + 2);
         print_string(member->name);
         printf(" : %zu\n", member->type);
-      }
+      });
       break;
 
     case THIR_VARIABLE_DECLARATION:
       print_indent(indent + 1);
       printf("Variable: ");
       print_string(thir->variable.name);
-      printf("\n");
+      printf("%s\n", thir->variable.is_const ? " [const]" : "");
       if (thir->variable.value) {
         print_indent(indent + 2);
         printf("Value:\n");
@@ -421,12 +813,102 @@ void pretty_print_thir(THIR *thir, int indent) {
   }
 }
 
+// writes what `source` means into `dst`, which never needs more room than source.length. returns its length.
+static size_t unescape_string_literal(String source, char *dst) {
+  char *start = dst;
+  const char *src = source.data;
+  const char *end = source.data + source.length;
+  while (src < end) {
+    if (*src == '\\' && src + 1 < end) {
+      src++;
+      switch (*src) {
+        case 'e':
+          *dst++ = '\x1B';
+          break;
+        case 'n':
+          *dst++ = '\n';
+          break;
+        case 't':
+          *dst++ = '\t';
+          break;
+        case 'r':
+          *dst++ = '\r';
+          break;
+        case 'f':
+          *dst++ = '\f';
+          break;
+        case 'v':
+          *dst++ = '\v';
+          break;
+        case 'a':
+          *dst++ = '\a';
+          break;
+        case 'b':
+          *dst++ = '\b';
+          break;
+        case '\\':
+          *dst++ = '\\';
+          break;
+        case '\'':
+          *dst++ = '\'';
+          break;
+        case '\"':
+          *dst++ = '\"';
+          break;
+        case '\?':
+          *dst++ = '\?';
+          break;
+        case '0':
+          *dst++ = '\0';
+          break;
+        default:
+          *dst++ = '\\';
+          *dst++ = *src;
+          break;
+      }
+    } else {
+      *dst++ = *src;
+    }
+    src++;
+  }
+  return dst - start;
+}
+
+u32 intern_string_literal(String source, String *value) {
+  pthread_mutex_lock(&string_pool.lock);
+  // unescaped straight into the pool, it never gets longer, and a duplicate gives the memory back.
+  Arena_Mark mark = arena_mark(&string_pool.arena);
+  char *buffer = ARENA_ALLOC_ARRAY(&string_pool.arena, char, source.length + 1);
+  size_t length = unescape_string_literal(source, buffer);
+  u64 hash = hash_bytes(buffer, length);
+
+  size_t cursor = 0, index;
+  while ((index = hash_index_next(&string_pool.index, hash, &cursor)) != HASH_INDEX_END) {
+    String *interned = V_PTR_AT(String, string_pool.strings, index);
+    if (interned->length == length && memcmp(interned->data, buffer, length) == 0) {
+      arena_rewind(&string_pool.arena, mark);
+      *value = *interned;
+      pthread_mutex_unlock(&string_pool.lock);
+      return index;
+    }
+  }
+
+  String interned = {.data = buffer, .length = length};
+  interned.data[length] = '\0';
+  index = string_pool.strings.length;
+  hash_index_insert(&string_pool.index, hash, index);
+  vector_push(&string_pool.strings, &interned);
+  pthread_mutex_unlock(&string_pool.lock);
+  *value = interned;
+  return index;
+}
+
 const char *thir_kind_to_string(THIRKind type) {
   switch (type) {
     THIRTypeNameCase(THIR_PROGRAM) THIRTypeNameCase(THIR_BLOCK) THIRTypeNameCase(THIR_BINARY_EXPRESSION)
         THIRTypeNameCase(THIR_CALL) THIRTypeNameCase(THIR_MEMBER_ACCESS) THIRTypeNameCase(THIR_IDENTIFIER)
             THIRTypeNameCase(THIR_NUMBER) THIRTypeNameCase(THIR_STRING) THIRTypeNameCase(THIR_RETURN)
-                THIRTypeNameCase(THIR_FUNCTION) THIRTypeNameCase(THIR_TYPE_DECLARATION)
+                THIRTypeNameCase(THIR_FUNCTION) THIRTypeNameCase(THIR_PARAMETER) THIRTypeNameCase(THIR_TYPE_DECLARATION)
                     THIRTypeNameCase(THIR_VARIABLE_DECLARATION) default : return "INVALID_THIR_KIND";
   }
 }
@@ -1,13 +1,13 @@
-
 #ifndef TYPER2_H
 #define TYPER2_H
 
 #include "graph.h"
+#include "query.h"
 #include "thir.h"
 
-bool dep_node_dependencies_resolved(DepNode *node);
-THIR *generate_thir_from_ast(AST *node, Vector *thir_symbols);
-void generate_thir_for_node(DepNode *node, Vector *thir_symbols, THIR *program);
-THIR *generate_thir(DepGraph *graph, DepNodeRegistry *registry, Vector *thir_symbols);
+THIR *generate_thir_from_ast(AST *node, Query_Engine *engine);
+THIR *generate_thir(Query_Engine *engine);
+// only types what @entry and @export functions transitively reference, and reports the rest as skipped.
+THIR *generate_thir_on_demand(Query_Engine *engine);
 
-#endif
\ No newline at end of file
+#endif